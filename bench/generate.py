@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+"""Generates the benchmark programs.
+
+The small workloads are checked in under programs/, the large one is
+generated next to them when the benchmarks run (see run.py).
+"""
+
+import argparse
+import os
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def arithmetic(calls=2000):
+    """Integer and double arithmetic in a few functions called many times."""
+    lines = [
+        "// Aritmetik: birkaç fonksiyon, çok sayıda çağrı",
+        "sayı kare(sayı x) {",
+        "    döndür x * x",
+        "}",
+        "sayı polinom(sayı x) {",
+        "    sayı a = kare(x) * 3",
+        "    sayı b = x * 7 - 11",
+        "    döndür a + b / 2 - x",
+        "}",
+        "ondalıklı ortalama(ondalıklı a, ondalıklı b) {",
+        "    döndür (a + b) / 2.0",
+        "}",
+        "sayı toplam = 0",
+        "ondalıklı orta = 0.0",
+    ]
+    for i in range(calls):
+        lines.append("toplam = toplam + polinom(%d)" % (i % 97))
+        if i % 10 == 0:
+            lines.append("orta = ortalama(orta, %d.5)" % (i % 13))
+    lines.append("sayi_yaz(toplam)")
+    return lines
+
+
+def slots(objects=200, depth=8):
+    """Deep chains of slot reads and writes on objects."""
+    lines = ["// Nesne yuvaları: derin getSlot/putSlot zincirleri"]
+    for i in range(objects):
+        name = "n%d" % i
+        path = name
+        for level in range(depth):
+            lines.append("%s.s%d = %s_%d" % (path, level, name, level))
+            path += ".s%d" % level
+        for _ in range(depth // 2):
+            lines.append("%s.son = %s" % (path, name))
+            lines.append("%s.kopya = %s" % (name, path))
+    lines.append("sayi_yaz(%d)" % objects)
+    return lines
+
+
+def functions(count=500, calls=4):
+    """Many small functions, each called a few times."""
+    lines = ["// Çok sayıda küçük fonksiyon"]
+    for i in range(count):
+        lines += [
+            "sayı f%d(sayı x, sayı y) {" % i,
+            "    döndür x * %d + y - %d" % (i % 7 + 1, i % 5),
+            "}",
+        ]
+    lines.append("sayı toplam = 0")
+    for i in range(count):
+        for j in range(calls):
+            lines.append("toplam = toplam + f%d(%d, toplam / %d)" % (i, j, i % 9 + 2))
+    lines.append("sayi_yaz(toplam)")
+    return lines
+
+
+def loops(iterations=2000000):
+    """Counted, conditional and nested loops, and şartlıgir state machines."""
+    return [
+        "// Döngüler: sayaçlı, koşullu ve iç içe",
+        "sayı topla(sayı n) {",
+        "    sayı toplam = 0",
+        "    çevrim (sayı i = 0, i < n, i = i + 1) {",
+        "        toplam = toplam + i * 3 - i / 7",
+        "    }",
+        "    döndür toplam",
+        "}",
+        "ondalıklı seri(sayı n) {",
+        "    ondalıklı toplam = 0.0",
+        "    çevrim (sayı i = 1, i <= n, i = i + 1) {",
+        "        toplam = toplam + 1.0 / i",
+        "    }",
+        "    döndür toplam",
+        "}",
+        "sayı collatz(sayı n) {",
+        "    sayı adim = 0",
+        "    sürece (n != 1) {",
+        "        eğer (n - n / 2 * 2 == 0) {",
+        "            n = n / 2",
+        "        } yoksa {",
+        "            n = 3 * n + 1",
+        "        }",
+        "        adim = adim + 1",
+        "    }",
+        "    döndür adim",
+        "}",
+        "sayı tablo(sayı n) {",
+        "    sayı toplam = 0",
+        "    çevrim (sayı i = 0, i < n, i = i + 1) {",
+        "        çevrim (sayı j = 0, j < 16, j = j + 1) {",
+        "            eğer (i == j) { atla }",
+        "            toplam = toplam + i * j",
+        "        }",
+        "    }",
+        "    döndür toplam",
+        "}",
+        "sayı makine(sayı n) {",
+        "    sayı hal = 0",
+        "    sayı sayac = 0",
+        "    çevrim (sayı i = 0, i < n, i = i + 1) {",
+        "        şartlıgir (hal) {",
+        "            durum 0 { hal = 1 }",
+        "            durum 1 {",
+        "                hal = 2",
+        "                sayac = sayac + 1",
+        "            }",
+        "            durum 2, 4 { hal = hal + 1 }",
+        "            durum 3 {",
+        "                hal = 0",
+        "                sayac = sayac + 2",
+        "            }",
+        "            kabul { hal = 0 }",
+        "        }",
+        "    }",
+        "    döndür sayac",
+        "}",
+        "sayı renk(yazı ad) {",
+        "    şartlıgir (ad) {",
+        "        durum \"kırmızı\", \"al\" { döndür 1 }",
+        "        durum \"yeşil\" { döndür 2 }",
+        "        durum \"mavi\" { döndür 3 }",
+        "    }",
+        "    döndür 0",
+        "}",
+        "sayi_yaz(topla(%d))" % iterations,
+        "sayi_yaz(makine(%d))" % iterations,
+        "sayı renkler = 0",
+        "çevrim (sayı k = 0, k < %d, k = k + 1) {" % (iterations // 100),
+        "    renkler = renkler + renk(\"mavi\") + renk(\"al\") + renk(\"mor\")",
+        "}",
+        "sayi_yaz(renkler)",
+        "eğer (seri(%d) > 10.0) { sayi_yaz(1) }" % iterations,
+        "sayı en = 0",
+        "çevrim (sayı k = 1, k < %d, k = k + 1) {" % (iterations // 100),
+        "    sayı c = collatz(k)",
+        "    eğer (c > en) { en = c }",
+        "}",
+        "sayi_yaz(en)",
+        "sayi_yaz(tablo(%d))" % (iterations // 16),
+    ]
+
+
+def large(count=20000, statements=12):
+    """A large generated file: many functions with long bodies."""
+    lines = ["// Büyük üretilmiş program"]
+    for i in range(count):
+        lines.append("sayı g%d(sayı a, sayı b) {" % i)
+        lines.append("    sayı t0 = a + b")
+        for s in range(1, statements):
+            lines.append("    sayı t%d = t%d * %d + a - b / %d" % (s, s - 1, s % 5 + 1, s % 3 + 1))
+        lines.append("    döndür t%d" % (statements - 1))
+        lines.append("}")
+    lines.append("sayı toplam = 0")
+    for i in range(0, count, 7):
+        lines.append("toplam = toplam + g%d(%d, 3)" % (i, i % 11))
+    lines.append("sayi_yaz(toplam)")
+    return lines
+
+
+WORKLOADS = {
+    "arithmetic": arithmetic,
+    "slots": slots,
+    "functions": functions,
+    "loops": loops,
+    "large": large,
+}
+
+CHECKED_IN = ["arithmetic", "slots", "functions", "loops"]
+
+
+def write(name, directory):
+    path = os.path.join(directory, name + ".program")
+    with open(path, "w", encoding="utf-8") as out:
+        out.write("\n".join(WORKLOADS[name]()) + "\n")
+    return path
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("names", nargs="*", default=CHECKED_IN,
+                        help="workloads to generate: " + ", ".join(sorted(WORKLOADS)))
+    parser.add_argument("--output", default=os.path.join(HERE, "programs"))
+    args = parser.parse_args()
+    for name in args.names:
+        if name not in WORKLOADS:
+            parser.error("unknown workload: " + name)
+    os.makedirs(args.output, exist_ok=True)
+    for name in args.names:
+        print(write(name, args.output))
+
+
+if __name__ == "__main__":
+    main()
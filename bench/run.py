@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Runs the benchmark programs and compares them against a baseline.
+
+Every workload is run with each configuration a few times. The phase
+times come from the compiler's own --stats= report; peak RSS comes from
+the rusage of the child process. Results are written as JSON. With
+--baseline, medians are compared and the script exits with status 1
+when a metric regressed by more than --threshold.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+import generate
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(HERE)
+
+# Compiler options of each configuration
+CONFIGURATIONS = {
+    "jit-O0": ["--tier=jit", "-O0"],
+    "jit-O2": ["--tier=jit", "-O2"],
+    "vm": ["--tier=vm"],
+}
+
+# Reported metrics and the phases of --stats= they are made of
+METRICS = {
+    "parse": ["frontend.parse"],
+    "codegen": ["codegen.coreFunctions", "codegen.generateCode", "vm.compileBytecode"],
+    "jit": ["llvm.optimize", "llvm.finalizeObject", "llvm.compileToObject"],
+    "execution": ["run.main", "vm.interpret"],
+    "total": ["compiler.total"],
+}
+
+
+def run_once(compiler, program, options):
+    """Runs the compiler once, returns its statistics or None on failure."""
+    with tempfile.NamedTemporaryFile(suffix=".json", delete=False) as stats:
+        path = stats.name
+    try:
+        command = [compiler, "--stats=" + path] + options + [program]
+        start = time.monotonic()
+        process = subprocess.Popen(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+        _, status, usage = os.wait4(process.pid, 0)
+        wall = time.monotonic() - start
+        stderr = process.stderr.read().decode("utf-8", "replace")
+        process.stderr.close()
+        code = os.waitstatus_to_exitcode(status)
+        if code != 0:
+            sys.stderr.write("%s %s failed with %d\n%s" % (program, " ".join(options), code, stderr[-2000:]))
+            return None
+        with open(path) as file:
+            stats = json.load(file)
+    finally:
+        os.unlink(path)
+
+    # ru_maxrss is in kilobytes on Linux and in bytes on macOS
+    rss = usage.ru_maxrss * (1 if sys.platform == "darwin" else 1024)
+    result = {"wallMs": wall * 1000.0, "peakRssBytes": rss}
+    phases = stats.get("phases", {})
+    for metric, names in METRICS.items():
+        result[metric + "Ms"] = sum(phases[name]["wallUs"] for name in names if name in phases) / 1000.0
+    result["counters"] = stats.get("counters", {})
+    return result
+
+
+def median(values):
+    values = sorted(values)
+    middle = len(values) // 2
+    return values[middle] if len(values) % 2 else (values[middle - 1] + values[middle]) / 2.0
+
+
+def summarize(runs):
+    summary = {key: median([run[key] for run in runs]) for key in runs[0] if key != "counters"}
+    summary["counters"] = runs[0]["counters"]
+    summary["runs"] = len(runs)
+    return summary
+
+
+def compare(results, baseline, threshold, min_delta):
+    """Prints the change of every metric, returns the regressed ones."""
+    regressions = []
+    print("\n%-28s %-16s %12s %12s %8s" % ("benchmark", "metric", "baseline", "current", "change"))
+    for name, current in sorted(results.items()):
+        previous = baseline.get(name)
+        if previous is None:
+            continue
+        for metric in sorted(current):
+            if metric in ("counters", "runs") or not previous.get(metric):
+                continue
+            change = (current[metric] - previous[metric]) / previous[metric]
+            flag = ""
+            # Changes of a few microseconds are noise, not regressions
+            noise = metric.endswith("Ms") and current[metric] - previous[metric] < min_delta
+            if change > threshold and not noise:
+                flag = " !"
+                regressions.append((name, metric, change))
+            print("%-28s %-16s %12.2f %12.2f %+7.1f%%%s" %
+                  (name, metric, previous[metric], current[metric], change * 100, flag))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--compiler", default=os.path.join(ROOT, "compiler"))
+    parser.add_argument("--repeat", type=int, default=5, help="runs per benchmark")
+    parser.add_argument("--config", action="append", choices=sorted(CONFIGURATIONS),
+                        help="configurations to run, all by default")
+    parser.add_argument("--workload", action="append", choices=sorted(generate.WORKLOADS),
+                        help="workloads to run, all by default")
+    parser.add_argument("--output", default=os.path.join(HERE, "results.json"),
+                        help="machine readable results")
+    parser.add_argument("--baseline", default=os.path.join(HERE, "baseline.json"),
+                        help="results to compare against, not checked in since they depend on the machine")
+    parser.add_argument("--save-baseline", action="store_true",
+                        help="store the results as the new baseline")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="relative slowdown reported as a regression")
+    parser.add_argument("--min-delta", type=float, default=1.0,
+                        help="slowdowns below this many milliseconds are ignored")
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp(prefix="bench-")
+    programs = {}
+    for name in args.workload or sorted(generate.WORKLOADS):
+        checked_in = os.path.join(HERE, "programs", name + ".program")
+        programs[name] = checked_in if os.path.exists(checked_in) else generate.write(name, workdir)
+
+    results = {}
+    failed = False
+    for workload, program in sorted(programs.items()):
+        for config in args.config or sorted(CONFIGURATIONS):
+            name = workload + "/" + config
+            runs = []
+            for _ in range(args.repeat):
+                run = run_once(args.compiler, program, CONFIGURATIONS[config])
+                if run is None:
+                    failed = True
+                    break
+                runs.append(run)
+            if not runs:
+                continue
+            results[name] = summarize(runs)
+            r = results[name]
+            print("%-28s parse %8.2f  codegen %8.2f  jit %8.2f  exec %8.2f  total %8.2f ms  rss %7.1f MB" %
+                  (name, r["parseMs"], r["codegenMs"], r["jitMs"], r["executionMs"], r["totalMs"],
+                   r["peakRssBytes"] / 1048576.0))
+
+    shutil.rmtree(workdir)
+    with open(args.output, "w") as file:
+        json.dump(results, file, indent=2, sort_keys=True)
+    print("\nResults: " + args.output)
+
+    if args.save_baseline:
+        with open(args.baseline, "w") as file:
+            json.dump(results, file, indent=2, sort_keys=True)
+        print("Baseline saved: " + args.baseline)
+    elif os.path.exists(args.baseline):
+        with open(args.baseline) as file:
+            regressions = compare(results, json.load(file), args.threshold, args.min_delta)
+        if regressions:
+            print("\n%d metrics regressed by more than %d%%" % (len(regressions), args.threshold * 100))
+            failed = True
+    else:
+        print("\nNo baseline at %s, nothing was compared. Store one from a reference build with\n"
+              "--save-baseline (make bench BENCH_FLAGS=--save-baseline)." % args.baseline)
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,67 @@
+#include "arena.h"
+#include <cstdlib>
+
+static thread_local Arena *currentArena = NULL;
+
+Arena::Arena() : chunks(NULL), cursor(NULL), end(NULL), allocated(0), cleanups(NULL)
+{
+}
+
+Arena::~Arena()
+{
+    release();
+}
+
+void Arena::addChunk(size_t minimum)
+{
+    size_t size = minimum + sizeof(Chunk) > ChunkSize ? minimum + sizeof(Chunk) : ChunkSize;
+    Chunk *chunk = (Chunk *) malloc(size);
+    if (chunk == NULL)
+        throw std::bad_alloc();
+    chunk->next = chunks;
+    chunk->size = size;
+    chunks = chunk;
+    cursor = (char *) (chunk + 1);
+    end = (char *) chunk + size;
+}
+
+void Arena::release()
+{
+    /* Objects may refer to each other, destroy them newest first */
+    while (cleanups) {
+        Cleanup *next = cleanups->next;
+        cleanups->destroy(cleanups->object);
+        cleanups = next;
+    }
+
+    while (chunks) {
+        Chunk *next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+    cursor = end = NULL;
+    allocated = 0;
+}
+
+size_t Arena::reservedBytes() const
+{
+    size_t size = 0;
+    for (Chunk *chunk = chunks; chunk; chunk = chunk->next)
+        size += chunk->size;
+    return size;
+}
+
+Arena *Arena::current()
+{
+    return currentArena;
+}
+
+Arena::Scope::Scope(Arena& arena) : previous(currentArena)
+{
+    currentArena = &arena;
+}
+
+Arena::Scope::~Scope()
+{
+    currentArena = previous;
+}
@@ -0,0 +1,135 @@
+#ifndef arena_h
+#define arena_h
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <utility>
+
+/* Bump allocator the parser builds the AST in. Memory is handed out from
+   large chunks and released all at once. Objects are not destroyed one by
+   one, only those registered with destroyOnRelease(). */
+class Arena {
+public:
+    static const size_t ChunkSize = 64 * 1024;
+    static const size_t Alignment = alignof(std::max_align_t);
+
+private:
+    struct Chunk {
+        Chunk *next;
+        size_t size;
+    };
+
+    /* Destructor to run on release, the records form a list through the
+       chunks so there is no growing table of them */
+    struct Cleanup {
+        Cleanup *next;
+        void (*destroy)(void *object);
+        void *object;
+    };
+
+    Chunk *chunks;
+    char *cursor;
+    char *end;
+    size_t allocated;
+    Cleanup *cleanups;
+
+    void addChunk(size_t minimum);
+
+    template<class T>
+    static void destroy(void *object) { ((T *) object)->~T(); }
+
+public:
+
+    Arena();
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void *allocate(size_t size, size_t alignment = Alignment) {
+        size_t start = ((size_t) cursor + alignment - 1) & ~(alignment - 1);
+        if (start + size > (size_t) end) {
+            addChunk(size + alignment);
+            start = ((size_t) cursor + alignment - 1) & ~(alignment - 1);
+        }
+        cursor = (char *) start + size;
+        allocated += size;
+        return (void *) start;
+    }
+
+    /* Copy of the text in the arena, terminated with a NUL */
+    const char *copy(const char *text, size_t length) {
+        char *copy = (char *) allocate(length + 1, 1);
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+        return copy;
+    }
+
+    /* Creates an object whose destructor is not needed, such as a list
+       of nodes with an ArenaAllocator */
+    template<class T, class... Args>
+    T *create(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /* Runs the destructor of an object of this arena when it is released,
+       for objects holding memory outside of it */
+    template<class T>
+    void destroyOnRelease(T *object) {
+        Cleanup *cleanup = (Cleanup *) allocate(sizeof(Cleanup), alignof(Cleanup));
+        cleanup->next = cleanups;
+        cleanup->destroy = destroy<T>;
+        cleanup->object = object;
+        cleanups = cleanup;
+    }
+
+    /* Destroys the registered objects and frees every chunk of the arena */
+    void release();
+
+    /* Bytes handed out and bytes reserved from the system */
+    size_t allocatedBytes() const { return allocated; }
+    size_t reservedBytes() const;
+
+    /* Arena the parser of this thread allocates in, NULL outside parsing */
+    static Arena *current();
+
+    /* Makes the arena current for the lifetime of the scope */
+    class Scope {
+        Arena *previous;
+    public:
+        Scope(Arena& arena);
+        ~Scope();
+    };
+};
+
+/* Allocator for containers of AST nodes, their elements go to the arena
+   that was current when the container was created, or to the heap. */
+template<class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    Arena *arena;
+
+    ArenaAllocator() : arena(Arena::current()) { }
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) { }
+
+    T *allocate(size_t count) {
+        if (arena == NULL)
+            return static_cast<T *>(::operator new(count * sizeof(T)));
+        return static_cast<T *>(arena->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *pointer, size_t count) {
+        if (arena == NULL)
+            ::operator delete(pointer);
+    }
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) { return lhs.arena == rhs.arena; }
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) { return lhs.arena != rhs.arena; }
+
+#endif // arena_h
@@ -2,17 +2,45 @@
 #include "codegen.h"
 #include "../grammar/parser.hpp"
 #include "types.h"
+#include "gc.h"
+#include "lazyjit.h"
+#include "typecheck.h"
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Object/ObjectFile.h>
+#include <set>
 #include <stdarg.h>
 #include <string>
 
 using namespace std;
 
-static StructType *ObjectType;
-static StructType *StringType;
-static PointerType *ObjectType_p;
-static PointerType *StringType_p;
+/* Counts the bytes of the text sections of every object MCJIT loads */
+class CodeSizeListener : public JITEventListener {
+public:
+    void NotifyObjectEmitted(const object::ObjectFile& object,
+                             const RuntimeDyld::LoadedObjectInfo& info) override {
+        if (!Statistics::enabled()) return;
+        for (const object::SectionRef& section : object.sections()) {
+            if (section.isText())
+                Statistics::add(Counter::MachineCodeBytes, section.getSize());
+        }
+    }
+};
+
+JITEventListener *codeSizeListener()
+{
+    static CodeSizeListener listener;
+    return &listener;
+}
 
-//mObject (*objalloc)() = NULL;
+size_t countInstructions(const Module& module)
+{
+    size_t count = 0;
+    for (const Function& function : module) {
+        for (const BasicBlock& block : function)
+            count += block.size();
+    }
+    return count;
+}
 
 StructType* CodeGenContext::addStructType(char *name, size_t numArgs, ...)
 {
@@ -64,73 +92,362 @@ Function* CodeGenContext::addFunction(char *name, FunctionType *fType, void (^bl
     return f;
 }
 
-/* Compile the AST into a module */
-void CodeGenContext::generateCode(NBlock& root)
+/* Declares the object types and the runtime functions generated code uses */
+void CodeGenContext::declareRuntime()
 {
-    LOG(LogLevel::Debug, "Generating code...");
-    static PointerType *GenericPointerType = PointerType::get(Type::getInt64Ty(module->getContext()), 0);
-
-    ObjectType = addStructType((char *) "mObject", 1, GenericPointerType);
-    ObjectType_p = PointerType::getUnqual(ObjectType);
-    StringType = addStructType((char *) "string", 3, GenericPointerType, GenericPointerType, Type::getInt64Ty(module->getContext()));
-    StringType_p = PointerType::getUnqual(StringType);
-
-    // TODO: Make use of objallocFunction
-    /* Create objalloc function */
-    //objallocFunction = addFunction((char *) "objalloc", functionType(ObjectType_p, false, 0), ^(BasicBlock *blk) {
-    //    Constant* allocSize = ConstantExpr::getSizeOf(ObjectType);
-    //    Value* a = CallInst::CreateMalloc(blk, Type::getInt64Ty(module->getContext()),
-    //                                      ObjectType,
-    //                                      allocSize);
-    //    ReturnInst::Create(module->getContext(), a, blk);
-    //});
-
-    /* Create refs to putSlot, getSlot and newobj */
+    PointerType *GenericPointerType = PointerType::get(Type::getInt64Ty(module->getContext()), 0);
+    Type *SymbolType = Type::getInt32Ty(module->getContext());
+
+    /* prototype, shape, overflow or dictionary, inline slots; see types.h */
+    objectType = addStructType((char *) "mObject", 2, GenericPointerType,
+        ArrayType::get(GenericPointerType, InlineSlotCount));
+    objectPointerType = PointerType::getUnqual(objectType);
+    vector<Type*> integerFields = { objectType, Type::getInt64Ty(module->getContext()) };
+    integerType = StructType::create(module->getContext(), makeArrayRef(integerFields), "cinteger");
+    vector<Type*> doubleFields = { objectType, Type::getDoubleTy(module->getContext()) };
+    doubleType = StructType::create(module->getContext(), makeArrayRef(doubleFields), "cdouble");
+    vector<Type*> stringFields = { objectType, Type::getInt8PtrTy(module->getContext()), Type::getInt64Ty(module->getContext()) };
+    stringType = StructType::create(module->getContext(), makeArrayRef(stringFields), "cstring");
+    stringPointerType = PointerType::getUnqual(stringType);
+
+    /* objalloc is the out-of-line path of allocateObject() */
+    objallocFunction = addExternalFunction((char *) "objalloc", functionType(objectPointerType, false, 0));
+    gcAllocationBufferFunction = addExternalFunction((char *) "gcAllocationBuffer",
+        functionType(Type::getInt8PtrTy(module->getContext()), false, 1, Type::getInt64Ty(module->getContext())));
+    intallocFunction = addExternalFunction((char *) "intalloc",
+        functionType(PointerType::getUnqual(integerType), false, 1, Type::getInt64Ty(module->getContext())));
+    dblallocFunction = addExternalFunction((char *) "dblalloc",
+        functionType(PointerType::getUnqual(doubleType), false, 1, Type::getDoubleTy(module->getContext())));
+    strallocFunction = addExternalFunction((char *) "stralloc",
+        functionType(stringPointerType, false, 2, Type::getInt8PtrTy(module->getContext()), Type::getInt64Ty(module->getContext())));
+    strlenFunction = addExternalFunction((char *) "strlen",
+        functionType(Type::getInt64Ty(module->getContext()), false, 1, Type::getInt8PtrTy(module->getContext())));
+    strhashFunction = addExternalFunction((char *) "strhash",
+        functionType(Type::getInt64Ty(module->getContext()), false, 1, Type::getInt8PtrTy(module->getContext())));
+    strcmpFunction = addExternalFunction((char *) "strcmp",
+        functionType(Type::getInt32Ty(module->getContext()), false, 2, Type::getInt8PtrTy(module->getContext()),
+                     Type::getInt8PtrTy(module->getContext())));
+    emptyShape = new GlobalVariable(*module, Type::getInt8Ty(module->getContext()), false,
+        GlobalValue::ExternalLinkage, NULL, "emptyShape");
+    integerShape = new GlobalVariable(*module, Type::getInt8Ty(module->getContext()), false,
+        GlobalValue::ExternalLinkage, NULL, "integerShape");
+    doubleShape = new GlobalVariable(*module, Type::getInt8Ty(module->getContext()), false,
+        GlobalValue::ExternalLinkage, NULL, "doubleShape");
+    stringShape = new GlobalVariable(*module, Type::getInt8Ty(module->getContext()), false,
+        GlobalValue::ExternalLinkage, NULL, "stringShape");
+    checkBoxFunction = addExternalFunction((char *) "checkBox",
+        functionType(Type::getVoidTy(module->getContext()), false, 2, objectPointerType,
+                     Type::getInt8PtrTy(module->getContext())));
+    divisionByZeroFunction = addExternalFunction((char *) "divisionByZero",
+        functionType(Type::getVoidTy(module->getContext()), false, 0));
+    divisionByZeroFunction->setDoesNotReturn();
+    allocationBuffers.clear();
+
+    /* Create refs to putSlot, getSlot, newobj and internSymbol */
     putSlotFunction = addExternalFunction((char *) "putSlot",
-        functionType(Type::getVoidTy(module->getContext()), false, 3, ObjectType_p, GenericPointerType, ObjectType_p));
+        functionType(Type::getVoidTy(module->getContext()), false, 3, objectPointerType, SymbolType, objectPointerType));
     getSlotFunction = addExternalFunction((char *) "getSlot",
-        functionType(ObjectType_p, false, 3, ObjectType_p, GenericPointerType, Type::getInt64Ty(module->getContext())));
+        functionType(objectPointerType, false, 3, objectPointerType, SymbolType, Type::getInt32Ty(module->getContext())));
     newobjFunction = addExternalFunction((char *) "newobj",
-        functionType(ObjectType_p, false, 1, ObjectType_p));
+        functionType(objectPointerType, false, 1, objectPointerType));
+    internSymbolFunction = addExternalFunction((char *) "internSymbol",
+        functionType(SymbolType, false, 1, Type::getInt8PtrTy(module->getContext())));
+
+    /* struct InlineCache of types.h */
+    Type *bytePointerType = Type::getInt8PtrTy(module->getContext());
+    vector<Type*> entryFields = { bytePointerType, SymbolType };
+    StructType *entryType = StructType::create(module->getContext(), makeArrayRef(entryFields), "InlineCacheEntry");
+    vector<Type*> cacheFields = {
+        ArrayType::get(entryType, InlineCacheEntries),
+        Type::getInt64Ty(module->getContext()), Type::getInt64Ty(module->getContext()),  // hits, misses
+        Type::getInt32Ty(module->getContext()), Type::getInt32Ty(module->getContext()),  // count, flags
+        bytePointerType, bytePointerType                                                   // site, next
+    };
+    inlineCacheType = StructType::create(module->getContext(), makeArrayRef(cacheFields), "InlineCache");
+    getSlotCachedFunction = addExternalFunction((char *) "getSlotCached",
+        functionType(objectPointerType, false, 3, objectPointerType, SymbolType, PointerType::getUnqual(inlineCacheType)));
+    putSlotCachedFunction = addExternalFunction((char *) "putSlotCached",
+        functionType(Type::getVoidTy(module->getContext()), false, 4, objectPointerType, SymbolType, objectPointerType,
+                     PointerType::getUnqual(inlineCacheType)));
+    gcPushFrameFunction = addExternalFunction((char *) "gcPushFrame",
+        functionType(Type::getVoidTy(module->getContext()), false, 1, Type::getInt8PtrTy(module->getContext())));
+    gcPopFrameFunction = addExternalFunction((char *) "gcPopFrame",
+        functionType(Type::getVoidTy(module->getContext()), false, 1, Type::getInt8PtrTy(module->getContext())));
+
+    symbols.clear();
+    symbolInitFunction = Function::Create(FunctionType::get(Type::getVoidTy(module->getContext()), false),
+        GlobalValue::ExternalLinkage, "sym.init", module);
+}
+
+GlobalVariable *CodeGenContext::symbol(const string& name)
+{
+    GlobalVariable *&global = symbols[name];
+    if (global == NULL) {
+        global = new GlobalVariable(*module, Type::getInt32Ty(module->getContext()), false,
+            GlobalValue::InternalLinkage, ConstantInt::get(Type::getInt32Ty(module->getContext()), 0),
+            "sym." + name);
+    }
+    return global;
+}
+
+/* Allocates an object without a prototype. The cell is taken from the
+   allocation buffer of the thread, objalloc refills it when it runs out. */
+Value *CodeGenContext::allocateObject()
+{
+    LLVMContext& context = module->getContext();
+    Function *function = currentBlock()->getParent();
+    Value *&buffer = allocationBuffers[function];
+    if (buffer == NULL) {
+        BasicBlock& entry = function->getEntryBlock();
+        IRBuilder<> entryBuilder(&entry, entry.begin());
+        buffer = entryBuilder.CreateCall(gcAllocationBufferFunction,
+            entryBuilder.getInt64(gcCellSize(sizeof(mObject))), "allocbuffer");
+    }
+
+    IRBuilder<> builder(currentBlock());
+    BasicBlock *fast = BasicBlock::Create(context, "alloc.fast", function);
+    BasicBlock *slow = BasicBlock::Create(context, "alloc.slow", function);
+    BasicBlock *done = BasicBlock::Create(context, "alloc.done", function);
+
+    /* struct GCAllocationBuffer { char *cursor; char *limit; } */
+    Type *bytePointerType = Type::getInt8PtrTy(context);
+    Value *cursorAddress = builder.CreatePointerCast(buffer, PointerType::getUnqual(bytePointerType));
+    Value *limitAddress = builder.CreateConstGEP1_32(bytePointerType, cursorAddress, 1);
+    Value *cursor = builder.CreateLoad(cursorAddress, "cursor");
+    /* Not inbounds, the cursor is NULL until the first refill */
+    Value *next = builder.CreateConstGEP1_32(Type::getInt8Ty(context), cursor, gcCellSize(sizeof(mObject)), "next");
+    Value *fits = builder.CreateICmpULE(next, builder.CreateLoad(limitAddress, "limit"));
+    builder.CreateCondBr(fits, fast, slow, MDBuilder(context).createBranchWeights(64, 1));
+
+    builder.SetInsertPoint(fast);
+    builder.CreateStore(next, cursorAddress);
+    Value *object = builder.CreatePointerCast(cursor, objectPointerType);
+    builder.CreateStore(ConstantPointerNull::get(cast<PointerType>(objectType->getElementType(0))),
+        builder.CreateStructGEP(objectType, object, 0));
+    builder.CreateStore(builder.CreatePtrToInt(emptyShape, Type::getInt64Ty(context)),
+        builder.CreateStructGEP(objectType, object, 1));
+    builder.CreateStore(ConstantPointerNull::get(cast<PointerType>(objectType->getElementType(2))),
+        builder.CreateStructGEP(objectType, object, 2));
+    builder.CreateBr(done);
+
+    builder.SetInsertPoint(slow);
+    Value *allocated = builder.CreateCall(objallocFunction);
+    builder.CreateBr(done);
+
+    builder.SetInsertPoint(done);
+    PHINode *result = builder.CreatePHI(objectPointerType, 2, "object");
+    result->addIncoming(object, fast);
+    result->addIncoming(allocated, slow);
+    setCurrentBlock(done);
+    return result;
+}
+
+AllocaInst *CodeGenContext::createLocal(Type *type, const string& name)
+{
+    BasicBlock& entry = currentBlock()->getParent()->getEntryBlock();
+    IRBuilder<> builder(&entry, entry.begin());
+    return builder.CreateAlloca(type, NULL, name);
+}
+
+/* The IDs of the process are only known when the code is loaded, so
+   sym.init interns the slot names of the module before it runs. Objects
+   from the code cache are correct in every process this way. */
+void CodeGenContext::defineSymbolInit()
+{
+    BasicBlock *block = BasicBlock::Create(module->getContext(), "entry", symbolInitFunction, 0);
+    IRBuilder<> builder(block);
+    for (auto& entry : symbols) {
+        Value *name = builder.CreateGlobalStringPtr(entry.first, "symname");
+        builder.CreateStore(builder.CreateCall(internSymbolFunction, name), entry.second);
+    }
+    builder.CreateRetVoid();
+}
+
+/* Generic functions can be called before their declaration, their
+   specializations are generated on the first call */
+void CodeGenContext::declareGenericFunctions(NBlock& root)
+{
+    for (NStatement *statement : root.statements) {
+        NFunctionDeclaration *decl = dynamic_cast<NFunctionDeclaration *>(statement);
+        if (decl && decl->isGeneric())
+            genericFunctions[decl->id.name.str()] = decl;
+    }
+}
+
+/* Compile the AST into a module, false if a call could not be compiled */
+bool CodeGenContext::generateCode(NBlock& root)
+{
+    LOG(LogLevel::Debug, "Generating code...");
+    TRACE_SCOPE("codegen", "generateCode");
+    declareRuntime();
 
     /* Create the top level interpreter function to call as entry */
     vector<Type*> argTypes;
-    FunctionType *ftype = FunctionType::get(Type::getVoidTy(module->getContext()), makeArrayRef(argTypes), false);
+    FunctionType *ftype = FunctionType::get(Type::getInt32Ty(module->getContext()), makeArrayRef(argTypes), false);
     mainFunction = Function::Create(ftype, GlobalValue::ExternalLinkage, "main", module);
     BasicBlock *bblock = BasicBlock::Create(module->getContext(), "entry", mainFunction, 0);
 
     /* Push a new variable/block context */
     pushBlock(bblock);
-    cObject = new GlobalVariable(*module, ObjectType, true,
+    if (options.optLevel > 0)
+        localObjects() = findLocalObjects(root);
+    cObject = new GlobalVariable(*module, objectType, true,
         GlobalValue::ExternalLinkage, 0, "class.Object");
+    declareGenericFunctions(root);
+    /* A döndür at the top level ends the program, its value is not used */
+    BasicBlock *returnBlock = BasicBlock::Create(module->getContext(), "return");
+    setReturnBlock(returnBlock, NULL);
     root.codeGen(*this); /* emit bytecode for the toplevel block */
-    ReturnInst::Create(module->getContext(), bblock);
+    BranchInst::Create(returnBlock, currentBlock());
+    mainFunction->getBasicBlockList().push_back(returnBlock);
+    ReturnInst::Create(module->getContext(), ConstantInt::get(Type::getInt32Ty(module->getContext()), 0), returnBlock);
     popBlock();
+    emitShadowStack(mainFunction);
+
+    defineSymbolInit();
+    CallInst::Create(symbolInitFunction, "", &bblock->front());
+
+    if (Statistics::enabled()) {
+        for (Function& function : *module) {
+            if (!function.isDeclaration())
+                Statistics::add(Counter::Functions, 1);
+        }
+        Statistics::add(Counter::IRInstructions, countInstructions(*module));
+    }
 
     /* Print the bytecode in a human-readable format
-       to see if our program compiled properly
-       Comment these lines after debugging.
+       to see if our program compiled properly, with --log=debug.
      */
     LOG(LogLevel::Debug, "Code is generated.");
-    module->dump();
+    if (LOG_ENABLED(LogLevel::Debug))
+        module->dump();
     LOG(LogLevel::Verbose, "Dump ends.");
+    return !failed;
+}
+
+/* Compiles only the function declarations of the AST, without a main
+   function. Used when the bytecode interpreter promotes hot functions. */
+bool CodeGenContext::generateFunctions(NBlock& root)
+{
+    LOG(LogLevel::Debug, "Generating functions...");
+    TRACE_SCOPE("codegen", "generateFunctions");
+    declareRuntime();
+    declareGenericFunctions(root);
+
+    StatementList::const_iterator it;
+    for (it = root.statements.begin(); it != root.statements.end(); it++) {
+        if (dynamic_cast<NFunctionDeclaration *>(*it) || dynamic_cast<NExternDeclaration *>(*it))
+            (**it).codeGen(*this);
+    }
+    defineSymbolInit();
+    LOG(LogLevel::Debug, "Functions are generated.");
+    return !failed;
 }
 
 /* Executes the AST by running the main function */
-void CodeGenContext::runCode() {
+int CodeGenContext::runCode() {
+    if (options.lazy) {
+        TargetMachine *tm = EngineBuilder().setOptLevel(codeGenOptLevel()).selectTarget();
+        if (tm && LazyJIT::isSupported(*tm))
+            return runCodeLazily(tm);
+        delete tm;
+        LOG(LogLevel::Warning, "Lazy compilation is not supported on this target, compiling eagerly");
+    }
+
     LOG(LogLevel::Debug, "Running code...");
     string error;
-    ExecutionEngine *ee = EngineBuilder(unique_ptr<Module>(module)).setErrorStr(&error).create();
-    // TODO: Make use of objalloc
-    //objalloc = (mObject (*)())ee->getPointerToFunction(objallocFunction);
-    ee->finalizeObject();
+    ExecutionEngine *ee = EngineBuilder(unique_ptr<Module>(module))
+        .setErrorStr(&error)
+        .setOptLevel(codeGenOptLevel())
+        .create();
+    module = NULL;
+    if (ee == NULL) {
+        LOG(LogLevel::Error, "Could not create the execution engine: " + error);
+        return 1;
+    }
+    if (objectCache)
+        ee->setObjectCache(objectCache);
+    ee->RegisterJITEventListener(codeSizeListener());
+    {
+        TRACE_SCOPE("llvm", "finalizeObject");
+        ee->finalizeObject();
+    }
 
+    TRACE_SCOPE("run", "main");
     const vector<string> argList;
-    ee->runFunctionAsMain(mainFunction, argList, 0);
+    int result = ee->runFunctionAsMain(mainFunction, argList, 0);
+    LOG(LogLevel::Info, "\033[0;32mCode was run.\x1b[0m");
+
+    if (error.length() > 0)
+        LOG(LogLevel::Error, "Error exist: " + error);
+    retireInlineCaches();
+    delete ee;
+    return result;
+}
+
+/* Executes the main function, compiling each function on its first call */
+int CodeGenContext::runCodeLazily(TargetMachine *targetMachine) {
+    LOG(LogLevel::Debug, "Running code lazily...");
+    LazyJIT jit(targetMachine);
+    jit.addModule(unique_ptr<Module>(module));
+    module = NULL;
+
+    orc::JITSymbol symbol = jit.findSymbol("main");
+    int (*entry)() = (int (*)()) symbol.getAddress();
+    if (entry == NULL) {
+        LOG(LogLevel::Error, "No main function in module");
+        return 1;
+    }
+    TRACE_SCOPE("run", "main");
+    int result = entry();
+    LOG(LogLevel::Info, "\033[0;32mCode was run.\x1b[0m");
+    retireInlineCaches();
+    return result;
+}
+
+/* Runs the main function of already compiled objects, e.g. from the code cache */
+int CodeGenContext::runObjects(vector<unique_ptr<MemoryBuffer>> objects) {
+    LOG(LogLevel::Debug, "Running compiled objects...");
+    string error;
+    ExecutionEngine *ee = EngineBuilder(unique_ptr<Module>(new Module("objects", *llvmContext)))
+        .setErrorStr(&error)
+        .setOptLevel(codeGenOptLevel())
+        .create();
+    if (ee == NULL) {
+        LOG(LogLevel::Error, "Could not create the execution engine: " + error);
+        return 1;
+    }
+    ee->RegisterJITEventListener(codeSizeListener());
+
+    for (unique_ptr<MemoryBuffer>& object : objects) {
+        ErrorOr<unique_ptr<object::ObjectFile>> file = object::ObjectFile::createObjectFile(object->getMemBufferRef());
+        if (!file) {
+            LOG(LogLevel::Error, "Invalid object: " + file.getError().message());
+            delete ee;
+            return 1;
+        }
+        ee->addObjectFile(object::OwningBinary<object::ObjectFile>(move(*file), move(object)));
+    }
+    {
+        TRACE_SCOPE("llvm", "finalizeObject");
+        ee->finalizeObject();
+    }
+
+    int (*entry)() = (int (*)()) ee->getFunctionAddress("main");
+    if (entry == NULL) {
+        LOG(LogLevel::Error, "No main function in compiled objects");
+        delete ee;
+        return 1;
+    }
+    TRACE_SCOPE("run", "main");
+    int result = entry();
     LOG(LogLevel::Info, "\033[0;32mCode was run.\x1b[0m");
 
     if (error.length() > 0)
         LOG(LogLevel::Error, "Error exist: " + error);
+    retireInlineCaches();
+    delete ee;
+    return result;
 }
 
 /* Returns an LLVM type based on the identifier */
@@ -142,45 +459,269 @@ static Type *typeOf(const VariableType type, CodeGenContext& context)
         case VariableType::Double:
             return Type::getDoubleTy(context.module->getContext());
         case VariableType::String:
+            return Type::getInt8PtrTy(context.module->getContext());
         case VariableType::Object:
-            return ObjectType_p;
+            return context.objectPointerType;
         default:
             return Type::getVoidTy(context.module->getContext());
     }
 }
 
-static Value* getStringConstant(const string& str, CodeGenContext& context)
+/* Converts a value to the type of a variable, argument or slot: integers
+   are promoted to doubles, numbers and strings are boxed into objects and
+   unboxed from them, null unboxes to zero. Unboxing checks the shape of
+   the box, checkBox() stops the program on other objects. checkTypes()
+   has ruled out the other conversions. */
+static Value *convert(CodeGenContext& context, Value *value, Type *type)
+{
+    Type *from = value->getType();
+    if (from == type) return value;
+    LLVMContext& llvmContext = context.module->getContext();
+    Type *bytePointerType = Type::getInt8PtrTy(llvmContext);
+    IRBuilder<> builder(context.currentBlock());
+    if (from->isIntegerTy(64) && type->isDoubleTy())
+        return builder.CreateSIToFP(value, type);
+
+    if (type == context.objectPointerType) {
+        Value *boxed;
+        if (from->isIntegerTy(64)) {
+            boxed = builder.CreateCall(context.intallocFunction, value);
+        } else if (from->isDoubleTy()) {
+            boxed = builder.CreateCall(context.dblallocFunction, value);
+        } else if (from == bytePointerType) {
+            Value *args[] = { value, builder.CreateCall(context.strlenFunction, value) };
+            boxed = builder.CreateCall(context.strallocFunction, args);
+        } else {
+            return value;
+        }
+        return builder.CreatePointerCast(boxed, context.objectPointerType);
+    }
+
+    StructType *boxType = NULL;
+    GlobalVariable *boxShape = NULL;
+    if (type->isIntegerTy(64)) boxType = context.integerType, boxShape = context.integerShape;
+    else if (type->isDoubleTy()) boxType = context.doubleType, boxShape = context.doubleShape;
+    else if (type == bytePointerType) boxType = context.stringType, boxShape = context.stringShape;
+    if (from != context.objectPointerType || boxType == NULL) return value;
+
+    Function *function = builder.GetInsertBlock()->getParent();
+    BasicBlock *object = builder.GetInsertBlock();
+    BasicBlock *check = BasicBlock::Create(llvmContext, "unbox.check", function);
+    BasicBlock *slow = BasicBlock::Create(llvmContext, "unbox.slow", function);
+    BasicBlock *unbox = BasicBlock::Create(llvmContext, "unbox", function);
+    BasicBlock *done = BasicBlock::Create(llvmContext, "unbox.done", function);
+    MDNode *likely = MDBuilder(llvmContext).createBranchWeights(64, 1);
+    builder.CreateCondBr(builder.CreateIsNull(value), done, check);
+    builder.SetInsertPoint(check);
+    Value *shape = builder.CreateLoad(builder.CreateStructGEP(context.objectType, value, 1), "shape");
+    builder.CreateCondBr(builder.CreateICmpEQ(shape, builder.CreatePtrToInt(boxShape, shape->getType())),
+        unbox, slow, likely);
+    builder.SetInsertPoint(slow);
+    Value *args[] = { value, boxShape };
+    builder.CreateCall(context.checkBoxFunction, args);
+    builder.CreateBr(unbox);
+    builder.SetInsertPoint(unbox);
+    Value *box = builder.CreatePointerCast(value, PointerType::getUnqual(boxType));
+    Value *unboxed = builder.CreateLoad(builder.CreateStructGEP(boxType, box, 1));
+    builder.CreateBr(done);
+    builder.SetInsertPoint(done);
+    PHINode *result = builder.CreatePHI(type, 2);
+    result->addIncoming(Constant::getNullValue(type), object);
+    result->addIncoming(unboxed, unbox);
+    context.setCurrentBlock(done);
+    return result;
+}
+
+/* Creates the inline cache of a slot access, the site names it in the statistics */
+static GlobalVariable *createInlineCache(CodeGenContext& context, const string& site)
+{
+    LLVMContext& llvmContext = context.module->getContext();
+    Constant *name = ConstantDataArray::getString(llvmContext, site);
+    GlobalVariable *nameGlobal = new GlobalVariable(*context.module, name->getType(), true,
+        GlobalValue::PrivateLinkage, name, ".ic.site");
+    Constant *zero = ConstantInt::get(Type::getInt32Ty(llvmContext), 0);
+    vector<Constant*> indices = { zero, zero };
+
+    StructType *entryType = cast<StructType>(context.inlineCacheType->getElementType(0)->getArrayElementType());
+    Constant *emptyShape = ConstantExpr::getIntToPtr(
+        ConstantInt::get(Type::getInt64Ty(llvmContext), (uint64_t) (uintptr_t) InlineCacheEmpty),
+        Type::getInt8PtrTy(llvmContext));
+    vector<Constant*> entryFields = { emptyShape, zero };
+    vector<Constant*> entries(InlineCacheEntries, ConstantStruct::get(entryType, entryFields));
+    vector<Constant*> fields = {
+        ConstantArray::get(cast<ArrayType>(context.inlineCacheType->getElementType(0)), entries),
+        ConstantInt::get(Type::getInt64Ty(llvmContext), 0), ConstantInt::get(Type::getInt64Ty(llvmContext), 0),
+        zero, zero,
+        ConstantExpr::getInBoundsGetElementPtr(name->getType(), nameGlobal, indices),
+        ConstantPointerNull::get(Type::getInt8PtrTy(llvmContext))
+    };
+    return new GlobalVariable(*context.module, context.inlineCacheType, false, GlobalValue::InternalLinkage,
+        ConstantStruct::get(context.inlineCacheType, fields), ".ic");
+}
+
+/* Emits the checks of the cache entries against the shape of the object,
+   unused entries hold InlineCacheEmpty and never match. Objects of other
+   shapes go to the miss block, on a hit the builder continues with the
+   address of the slot. Only code compiled while statistics are collected
+   counts the hits. */
+static Value *emitCacheCheck(CodeGenContext& context, IRBuilder<>& builder, Value *object,
+                             GlobalVariable *cache, BasicBlock *miss)
+{
+    LLVMContext& llvmContext = context.module->getContext();
+    Function *function = builder.GetInsertBlock()->getParent();
+    BasicBlock *check = BasicBlock::Create(llvmContext, "ic.check", function);
+    BasicBlock *hit = BasicBlock::Create(llvmContext, "ic.hit", function);
+    BasicBlock *inlineSlot = BasicBlock::Create(llvmContext, "ic.inline", function);
+    BasicBlock *overflowSlot = BasicBlock::Create(llvmContext, "ic.overflow", function);
+    BasicBlock *found = BasicBlock::Create(llvmContext, "ic.found", function);
+    MDNode *likely = MDBuilder(llvmContext).createBranchWeights(64, 1);
+
+    builder.CreateCondBr(builder.CreateIsNull(object), miss, check, MDBuilder(llvmContext).createBranchWeights(1, 64));
+    builder.SetInsertPoint(check);
+    Value *shape = builder.CreateLoad(builder.CreateStructGEP(context.objectType, object, 1), "shape");
+    PHINode *index = PHINode::Create(builder.getInt32Ty(), InlineCacheEntries, "index", hit);
+    for (unsigned i = 0; i < InlineCacheEntries; i++) {
+        BasicBlock *entryHit = BasicBlock::Create(llvmContext, "ic.entry", function);
+        BasicBlock *next = i + 1 < InlineCacheEntries ? BasicBlock::Create(llvmContext, "ic.check", function) : miss;
+        Value *shapeIndices[] = { builder.getInt32(0), builder.getInt32(0), builder.getInt32(i), builder.getInt32(0) };
+        Value *entryShape = builder.CreateLoad(builder.CreateInBoundsGEP(context.inlineCacheType, cache, shapeIndices));
+        builder.CreateCondBr(builder.CreateICmpEQ(shape, builder.CreatePtrToInt(entryShape, shape->getType())),
+            entryHit, next, i == 0 ? likely : NULL);
+
+        builder.SetInsertPoint(entryHit);
+        Value *indexIndices[] = { builder.getInt32(0), builder.getInt32(0), builder.getInt32(i), builder.getInt32(1) };
+        index->addIncoming(builder.CreateLoad(builder.CreateInBoundsGEP(context.inlineCacheType, cache, indexIndices)),
+            entryHit);
+        builder.CreateBr(hit);
+        if (next != miss) builder.SetInsertPoint(next);
+    }
+
+    builder.SetInsertPoint(hit);
+    if (Statistics::enabled()) {
+        Value *hits = builder.CreateStructGEP(context.inlineCacheType, cache, 1);
+        builder.CreateStore(builder.CreateAdd(builder.CreateLoad(hits), builder.getInt64(1)), hits);
+    }
+    builder.CreateCondBr(builder.CreateICmpULT(index, builder.getInt32(InlineSlotCount)),
+        inlineSlot, overflowSlot, likely);
+
+    Type *slotPointerType = PointerType::getUnqual(context.objectPointerType);
+    builder.SetInsertPoint(inlineSlot);
+    Value *indices[] = { builder.getInt32(0), builder.getInt32(3), index };
+    Value *inlineAddress = builder.CreatePointerCast(
+        builder.CreateInBoundsGEP(context.objectType, object, indices), slotPointerType);
+    builder.CreateBr(found);
+
+    builder.SetInsertPoint(overflowSlot);
+    Value *overflow = builder.CreatePointerCast(
+        builder.CreateLoad(builder.CreateStructGEP(context.objectType, object, 2)), slotPointerType);
+    Value *overflowAddress = builder.CreateInBoundsGEP(context.objectPointerType, overflow,
+        builder.CreateSub(index, builder.getInt32(InlineSlotCount)));
+    builder.CreateBr(found);
+
+    builder.SetInsertPoint(found);
+    PHINode *address = builder.CreatePHI(slotPointerType, 2, "slot");
+    address->addIncoming(inlineAddress, inlineSlot);
+    address->addIncoming(overflowAddress, overflowSlot);
+    return address;
+}
+
+/* Reads the slot of the object through the inline cache of the site */
+static Value *cachedGetSlot(CodeGenContext& context, Value *object, const string& name, const string& site)
 {
-    LOG(LogLevel::Verbose, "getStringConstant str: " + str);
-    Constant *n = ConstantDataArray::getString(context.module->getContext(), str.c_str(), true);
-    GlobalVariable *g = new GlobalVariable(*context.module, n->getType(), true,
-        GlobalValue::InternalLinkage, 0, str.c_str());
-    g->setInitializer(n);
-    vector<Constant*> ptr;
-    ptr.push_back(ConstantInt::get(Type::getInt64Ty(context.module->getContext()), 0));
-    ptr.push_back(ConstantInt::get(Type::getInt64Ty(context.module->getContext()), 0));
-    return ConstantExpr::getGetElementPtr(PointerType::get(Type::getInt64Ty(context.module->getContext()), 0), g, ptr[0], ptr.size());
+    LLVMContext& llvmContext = context.module->getContext();
+    GlobalVariable *cache = createInlineCache(context, site);
+    IRBuilder<> builder(context.currentBlock());
+    Function *function = builder.GetInsertBlock()->getParent();
+    BasicBlock *miss = BasicBlock::Create(llvmContext, "ic.miss", function);
+    BasicBlock *done = BasicBlock::Create(llvmContext, "ic.done", function);
+
+    Value *hitValue = builder.CreateLoad(emitCacheCheck(context, builder, object, cache, miss));
+    BasicBlock *hitBlock = builder.GetInsertBlock();
+    builder.CreateBr(done);
+
+    builder.SetInsertPoint(miss);
+    Value *args[] = { object, builder.CreateLoad(context.symbol(name), name), cache };
+    Value *missValue = builder.CreateCall(context.getSlotCachedFunction, args);
+    builder.CreateBr(done);
+
+    builder.SetInsertPoint(done);
+    PHINode *value = builder.CreatePHI(context.objectPointerType, 2, name);
+    value->addIncoming(hitValue, hitBlock);
+    value->addIncoming(missValue, miss);
+    context.setCurrentBlock(done);
+    return value;
+}
+
+/* Writes the slot of the object through the inline cache of the site */
+static void cachedPutSlot(CodeGenContext& context, Value *object, const string& name, Value *value, const string& site)
+{
+    LLVMContext& llvmContext = context.module->getContext();
+    GlobalVariable *cache = createInlineCache(context, site);
+    IRBuilder<> builder(context.currentBlock());
+    Function *function = builder.GetInsertBlock()->getParent();
+    BasicBlock *miss = BasicBlock::Create(llvmContext, "ic.miss", function);
+    BasicBlock *done = BasicBlock::Create(llvmContext, "ic.done", function);
+
+    builder.CreateStore(value, emitCacheCheck(context, builder, object, cache, miss));
+    builder.CreateBr(done);
+
+    builder.SetInsertPoint(miss);
+    Value *args[] = { object, builder.CreateLoad(context.symbol(name), name), value, cache };
+    builder.CreateCall(context.putSlotCachedFunction, args);
+    builder.CreateBr(done);
+    context.setCurrentBlock(done);
+}
+
+/* Name of the access in the statistics, e.g. "main:a.b" */
+static string siteName(CodeGenContext& context, const string& path)
+{
+    return context.currentBlock()->getParent()->getName().str() + ":" + path;
+}
+
+/* Local of a slot of a local object (escape.h). The slots are set to
+   null where the object would have been allocated, its first use. They
+   are plain locals, promoted to SSA values like the others and only
+   stored in the GC frame across calls that can collect. */
+static Value *localObjectSlot(CodeGenContext& context, const string& object, const string& slot)
+{
+    map<string, Value*>& locals = context.locals();
+    const vector<string>& slots = context.localObjects()[object];
+    if (locals.find(object + "." + slots.front()) == locals.end()) {
+        LOG(LogLevel::Verbose, "Replacing object by its slots: " + object);
+        for (const string& name : slots) {
+            AllocaInst *alloc = context.createLocal(context.objectPointerType, object + "." + name);
+            new StoreInst(ConstantPointerNull::get(context.objectPointerType), alloc, false, context.currentBlock());
+            locals[object + "." + name] = alloc;
+        }
+        if (Statistics::enabled())
+            Statistics::add(Counter::LocalObjects, 1);
+    }
+    return locals[object + "." + slot];
+}
+
+static bool isLocalObject(CodeGenContext& context, const NReference& ref)
+{
+    return ref.refs.size() > 1 && context.localObjects().count(ref.refs.front()->name.str());
 }
 
 static Value* resolveReference(NReference& ref, CodeGenContext& context, bool ignoreLast = false)
 {
-    Value *curValue = ref.refs.front()->codeGen(context);
-    IdentifierList::const_iterator it;
-    for (it = ref.refs.begin() + 1; it != ref.refs.end(); it++) {
+    Value *curValue;
+    string path = ref.refs.front()->name.str();
+    IdentifierList::const_iterator it = ref.refs.begin() + 1;
+    if (isLocalObject(context, ref)) {
+        curValue = new LoadInst(localObjectSlot(context, path, (*it)->name.str()), "", false, context.currentBlock());
+        path += "." + (*it++)->name.str();
+    } else {
+        curValue = ref.refs.front()->codeGen(context);
+    }
+    for (; it != ref.refs.end(); it++) {
         NIdentifier& ident = **it;
         if (ignoreLast && it == ref.refs.end() - 1) return curValue;
 
-        LOG(LogLevel::Verbose, "Next ident: " + ident.name);
-        Value *ch = getStringConstant(ident.name, context);
-
-        vector<Value*> params;
-        params.push_back(curValue);
-        params.push_back(ch);
-        params.push_back(ConstantInt::get(Type::getInt64Ty(context.module->getContext()), 1));
-        LOG(LogLevel::Verbose, "About to call " + string(typeid(curValue).name()) + "::" + typeid(ch).name());
-        CallInst *call = CallInst::Create(context.getSlotFunction, makeArrayRef(params), "");
-        call->setCallingConv(CallingConv::C);
-        curValue = call;
+        LOG(LogLevel::Verbose, "Next ident: " + ident.name.str());
+        path += "." + ident.name.str();
+        curValue = cachedGetSlot(context, curValue, ident.name.str(), siteName(context, path));
     }
     return curValue;
 }
@@ -201,42 +742,46 @@ Value* NDouble::codeGen(CodeGenContext& context)
 
 Value* NIdentifier::codeGen(CodeGenContext& context)
 {
-    LOG(LogLevel::Verbose, "Creating identifier: " + name);
+    LOG(LogLevel::Verbose, "Creating identifier: " + name.str());
     if (name.compare("null") == 0) {
         LOG(LogLevel::Verbose, "IDENTIFIER 1");
-        return ConstantPointerNull::get(ObjectType_p);
+        return ConstantPointerNull::get(context.objectPointerType);
     }
 
-    if (context.locals().find(name) == context.locals().end()) {
-        LOG(LogLevel::Verbose, "Instantiating object: " + name);
-        vector<Value*> args;
-        args.push_back(ConstantPointerNull::get(ObjectType_p));
-        CallInst *call = CallInst::Create(context.newobjFunction, makeArrayRef(args), "");
-        return context.locals()[name] = call;
+    if (context.locals().find(name.str()) == context.locals().end()) {
+        LOG(LogLevel::Verbose, "Instantiating object: " + name.str());
+        Value *object = context.allocateObject();
+        AllocaInst *alloc = context.createLocal(context.objectPointerType, name.str());
+        new StoreInst(object, alloc, false, context.currentBlock());
+        context.locals()[name.str()] = alloc;
+        return object;
     }
 
-    return new LoadInst(context.locals()[name], "", false, context.currentBlock());
+    return new LoadInst(context.locals()[name.str()], "", false, context.currentBlock());
 }
 
 Value* NString::codeGen(CodeGenContext& context)
 {
-    LOG(LogLevel::Verbose, "Creating string: " + value);
+    LOG(LogLevel::Verbose, "Creating string: " + value.str());
     Constant *format_const = ConstantDataArray::getString(context.module->getContext(), value);
     GlobalVariable *var =
         new GlobalVariable(
-            *context.module, ArrayType::get(IntegerType::get(context.module->getContext(), 8), value.length() + 1),
+            *context.module, ArrayType::get(IntegerType::get(context.module->getContext(), 8), value.size() + 1),
             true, GlobalValue::PrivateLinkage, format_const, ".str");
     // Old NString codegen
-    //args.push_back(ConstantPointerNull::get(ObjectType_p));
+    //args.push_back(ConstantPointerNull::get(objectPointerType));
     //return CallInst::Create(context.newobjFunction, makeArrayRef(args), "");
-    return var;
+    /* Strings are char pointers, like in the interpreter */
+    Constant *zero = ConstantInt::get(Type::getInt32Ty(context.module->getContext()), 0);
+    vector<Constant*> indices = { zero, zero };
+    return ConstantExpr::getInBoundsGetElementPtr(var->getValueType(), var, indices);
 }
 
 Value* NReference::codeGen(CodeGenContext& context)
 {
     if (refs.size() == 1) {
         NIdentifier *ident = refs.front();
-        LOG(LogLevel::Verbose, "Creating reference 1: " + ident->name);
+        LOG(LogLevel::Verbose, "Creating reference 1: " + ident->name.str());
         return ident->codeGen(context);
     }
 
@@ -244,41 +789,152 @@ Value* NReference::codeGen(CodeGenContext& context)
     return resolveReference(*this, context);
 }
 
+static Function *generateFunction(CodeGenContext& context, NFunctionDeclaration& decl, const string& name,
+                                  const vector<VariableType>& types, VariableType returnType);
+
+/* Static type of a generated value */
+static VariableType variableType(Type *type, CodeGenContext& context)
+{
+    if (type->isIntegerTy(64)) return VariableType::Integer;
+    if (type->isDoubleTy()) return VariableType::Double;
+    if (type == Type::getInt8PtrTy(context.module->getContext())) return VariableType::String;
+    return VariableType::Object;
+}
+
+/* Specialization of a generic function for the types of the arguments,
+   e.g. topla<sayı,ondalıklı>. It is generated on the first call with
+   these types, checkTypes() has inferred its return type. */
+static Function *specialize(CodeGenContext& context, NFunctionDeclaration& decl, const vector<Value*>& args)
+{
+    vector<VariableType> types;
+    string name = decl.id.name.str() + "<";
+    for (size_t i = 0; i < decl.arguments.size() && i < args.size(); i++) {
+        VariableType type = decl.arguments[i]->type;
+        if (type == VariableType::Any) type = variableType(args[i]->getType(), context);
+        types.push_back(type);
+        name += string(i ? "," : "") + typeName(type);
+    }
+    name += ">";
+
+    if (Function *function = context.module->getFunction(name))
+        return function;
+    map<vector<VariableType>, VariableType>::iterator it = decl.specializations.find(types);
+    if (it == decl.specializations.end()) {
+        LOG(LogLevel::Error, "No specialization " + name);
+        return NULL;
+    }
+    LOG(LogLevel::Debug, "Specializing " + name);
+    if (Statistics::enabled())
+        Statistics::add(Counter::Specializations, 1);
+    return generateFunction(context, decl, name, types, it->second);
+}
+
 Value* NMethodCall::codeGen(CodeGenContext& context)
 {
     NIdentifier& id = *ref.refs.front();
-    LOG(LogLevel::Verbose, "Creating method call for: " + id.name);
-    Function *function = context.module->getFunction(id.name.c_str());
-    if (function == NULL) {
-        LOG(LogLevel::Error, "No such function " + id.name);
-    }
+    LOG(LogLevel::Verbose, "Creating method call for: " + id.name.str());
     vector<Value*> args;
     ExpressionList::const_iterator it;
     for (it = arguments.begin(); it != arguments.end(); it++) {
         args.push_back((**it).codeGen(context));
     }
 
-    CallInst *call = CallInst::Create(function, args, "", context.currentBlock());
-    return call;
+    Function *function = context.module->getFunction(id.name);
+    map<string, NFunctionDeclaration*>::iterator generic = context.genericFunctions.find(id.name.str());
+    if (generic != context.genericFunctions.end())
+        function = specialize(context, *generic->second, args);
+    if (function == NULL) {
+        LOG(LogLevel::Error, "No such function " + id.name.str());
+        /* Go on to report the other calls, the module is not used.
+           A null object converts to whatever type the caller needs. */
+        context.failed = true;
+        return ConstantPointerNull::get(context.objectPointerType);
+    }
+    for (size_t i = 0; i < args.size() && i < function->arg_size(); i++)
+        args[i] = convert(context, args[i], function->getFunctionType()->getParamType(i));
+
+    return CallInst::Create(function, args, "", context.currentBlock());
+}
+
+/* sayı division with the semantics of the interpreter: dividing by zero
+   is a runtime error, and x / -1 is -x, so LLONG_MIN / -1 wraps around
+   instead of trapping */
+static Value *divideIntegers(CodeGenContext& context, Value *left, Value *right)
+{
+    LLVMContext& llvmContext = context.module->getContext();
+    IRBuilder<> builder(context.currentBlock());
+    Function *function = builder.GetInsertBlock()->getParent();
+    BasicBlock *zero = BasicBlock::Create(llvmContext, "div.zero", function);
+    BasicBlock *check = BasicBlock::Create(llvmContext, "div.check", function);
+    BasicBlock *negate = BasicBlock::Create(llvmContext, "div.negate", function);
+    BasicBlock *divide = BasicBlock::Create(llvmContext, "div", function);
+    BasicBlock *done = BasicBlock::Create(llvmContext, "div.done", function);
+    MDNode *unlikely = MDBuilder(llvmContext).createBranchWeights(1, 64);
+
+    builder.CreateCondBr(builder.CreateICmpEQ(right, builder.getInt64(0)), zero, check, unlikely);
+    builder.SetInsertPoint(zero);
+    builder.CreateCall(context.divisionByZeroFunction);
+    builder.CreateUnreachable();
+
+    builder.SetInsertPoint(check);
+    builder.CreateCondBr(builder.CreateICmpEQ(right, builder.getInt64(-1)), negate, divide, unlikely);
+    builder.SetInsertPoint(negate);
+    Value *negated = builder.CreateSub(builder.getInt64(0), left);
+    builder.CreateBr(done);
+    builder.SetInsertPoint(divide);
+    Value *quotient = builder.CreateSDiv(left, right);
+    builder.CreateBr(done);
+
+    builder.SetInsertPoint(done);
+    PHINode *result = builder.CreatePHI(builder.getInt64Ty(), 2);
+    result->addIncoming(negated, negate);
+    result->addIncoming(quotient, divide);
+    context.setCurrentBlock(done);
+    return result;
 }
 
 Value* NBinaryOperator::codeGen(CodeGenContext& context)
 {
     LOG(LogLevel::Verbose, "Creating binary operation " + to_string(op));
+    /* Unboxed arithmetic, in doubles when one of the operands is a double.
+       These are the types checkTypes() inferred, but generic functions
+       have different ones in each specialization. */
+    Value *left = lhs.codeGen(context);
+    Value *right = rhs.codeGen(context);
+    bool isDouble = left->getType()->isDoubleTy() || right->getType()->isDoubleTy();
+    Type *operandType = isDouble ? Type::getDoubleTy(context.module->getContext())
+                                 : Type::getInt64Ty(context.module->getContext());
     Instruction::BinaryOps instr;
+    CmpInst::Predicate predicate;
     switch (op) {
-        case TPLUS:     instr = Instruction::Add; goto math;
-        case TMINUS:    instr = Instruction::Sub; goto math;
-        case TMUL:      instr = Instruction::Mul; goto math;
-        case TDIV:      instr = Instruction::SDiv; goto math;
+        case TPLUS:     instr = isDouble ? Instruction::FAdd : Instruction::Add; goto math;
+        case TMINUS:    instr = isDouble ? Instruction::FSub : Instruction::Sub; goto math;
+        case TMUL:      instr = isDouble ? Instruction::FMul : Instruction::Mul; goto math;
+        case TDIV:      instr = isDouble ? Instruction::FDiv : Instruction::SDiv; goto math;
 
-        /* TODO comparison */
+        /* Ordered, except != which is true for NaN like in C */
+        case TCEQ:      predicate = isDouble ? CmpInst::FCMP_OEQ : CmpInst::ICMP_EQ; goto compare;
+        case TCNE:      predicate = isDouble ? CmpInst::FCMP_UNE : CmpInst::ICMP_NE; goto compare;
+        case TCLT:      predicate = isDouble ? CmpInst::FCMP_OLT : CmpInst::ICMP_SLT; goto compare;
+        case TCLE:      predicate = isDouble ? CmpInst::FCMP_OLE : CmpInst::ICMP_SLE; goto compare;
+        case TCGT:      predicate = isDouble ? CmpInst::FCMP_OGT : CmpInst::ICMP_SGT; goto compare;
+        case TCGE:      predicate = isDouble ? CmpInst::FCMP_OGE : CmpInst::ICMP_SGE; goto compare;
     }
 
     return NULL;
 math:
-    return BinaryOperator::Create(instr, lhs.codeGen(context),
-        rhs.codeGen(context), "", context.currentBlock());
+    left = convert(context, left, operandType);
+    right = convert(context, right, operandType);
+    if (instr == Instruction::SDiv)
+        return divideIntegers(context, left, right);
+    return BinaryOperator::Create(instr, left, right, "", context.currentBlock());
+compare:
+    /* Comparisons are sayı, 0 or 1 */
+    left = convert(context, left, operandType);
+    right = convert(context, right, operandType);
+    IRBuilder<> builder(context.currentBlock());
+    Value *result = isDouble ? builder.CreateFCmp(predicate, left, right) : builder.CreateICmp(predicate, left, right);
+    return builder.CreateZExt(result, builder.getInt64Ty());
 }
 
 Value* NAssignment::codeGen(CodeGenContext& context)
@@ -286,19 +942,26 @@ Value* NAssignment::codeGen(CodeGenContext& context)
     LOG(LogLevel::Debug, "Creating assignment");
     if (lhs.refs.size() == 1) {
         LOG(LogLevel::Verbose, "Assignment refs.size == 1");
-        return new StoreInst(rhs.codeGen(context), context.locals()[lhs.refs.front()->name], false, context.currentBlock());
+        AllocaInst *local = cast<AllocaInst>(context.locals()[lhs.refs.front()->name.str()]);
+        Value *assigned = convert(context, rhs.codeGen(context), local->getAllocatedType());
+        new StoreInst(assigned, local, false, context.currentBlock());
+        return assigned;
+    } else if (lhs.refs.size() == 2 && isLocalObject(context, lhs)) {
+        LOG(LogLevel::Verbose, "Assignment to a local object");
+        Value *slot = localObjectSlot(context, lhs.refs.front()->name.str(), lhs.refs.back()->name.str());
+        Value *assigned = rhs.codeGen(context);
+        new StoreInst(convert(context, assigned, context.objectPointerType), slot, false, context.currentBlock());
+        return assigned;
     } else {
         LOG(LogLevel::Verbose, "Assignment refs.size != 1");
         Value *value = resolveReference(lhs, context, true);
-        Value *sym = getStringConstant(lhs.refs.back()->name, context);
-
-        vector<Value*> params;
-        params.push_back(value);
-        params.push_back(sym);
-        params.push_back(rhs.codeGen(context));
-        CallInst *call = CallInst::Create(context.putSlotFunction, makeArrayRef(params), "");
-        call->setCallingConv(CallingConv::C);
-        return call;
+        Value *assigned = rhs.codeGen(context);
+        string path;
+        for (NIdentifier *ident : lhs.refs)
+            path += (path.empty() ? "" : ".") + ident->name.str();
+        cachedPutSlot(context, value, lhs.refs.back()->name.str(), convert(context, assigned, context.objectPointerType),
+                      siteName(context, path));
+        return assigned;
     }
 }
 
@@ -321,19 +984,341 @@ Value* NExpressionStatement::codeGen(CodeGenContext& context)
     return expression.codeGen(context);
 }
 
+/* Appends the block to the function, code generation continues in it */
+static void enterBlock(CodeGenContext& context, BasicBlock *block)
+{
+    context.currentBlock()->getParent()->getBasicBlockList().push_back(block);
+    context.setCurrentBlock(block);
+}
+
+/* Branches to the target of a döndür, çık or atla. The statements after
+   it are unreachable, they go to a block without predecessors. */
+static void jump(CodeGenContext& context, BasicBlock *target)
+{
+    BranchInst::Create(target, context.currentBlock());
+    enterBlock(context, BasicBlock::Create(context.module->getContext(), "unreachable"));
+}
+
+/* Branches on the value of the condition, numbers other than zero are true */
+static BranchInst *branch(CodeGenContext& context, NExpression& condition, BasicBlock *ifTrue, BasicBlock *ifFalse)
+{
+    Value *value = condition.codeGen(context);
+    IRBuilder<> builder(context.currentBlock());
+    Value *isTrue = value->getType()->isDoubleTy()
+        ? builder.CreateFCmpUNE(value, ConstantFP::get(value->getType(), 0.0))
+        : builder.CreateICmpNE(value, Constant::getNullValue(value->getType()));
+    return builder.CreateCondBr(isTrue, ifTrue, ifFalse);
+}
+
 Value* NReturnStatement::codeGen(CodeGenContext& context)
 {
     LOG(LogLevel::Verbose, "Generating return code for" + string(typeid(expression).name()));
     Value *returnValue = expression.codeGen(context);
-    context.setCurrentReturnValue(returnValue);
+    if (AllocaInst *slot = context.returnSlot()) {
+        returnValue = convert(context, returnValue, slot->getAllocatedType());
+        new StoreInst(returnValue, slot, false, context.currentBlock());
+    }
+    jump(context, context.returnBlock());
     return returnValue;
 }
 
+Value* NIfStatement::codeGen(CodeGenContext& context)
+{
+    LOG(LogLevel::Verbose, "Creating if statement");
+    LLVMContext& llvmContext = context.module->getContext();
+    BasicBlock *thenEntry = BasicBlock::Create(llvmContext, "if.then");
+    BasicBlock *elseEntry = elseBlock ? BasicBlock::Create(llvmContext, "if.else") : NULL;
+    BasicBlock *end = BasicBlock::Create(llvmContext, "if.end");
+    branch(context, *condition, thenEntry, elseEntry ? elseEntry : end);
+
+    enterBlock(context, thenEntry);
+    thenBlock.codeGen(context);
+    BranchInst::Create(end, context.currentBlock());
+    if (elseBlock) {
+        enterBlock(context, elseEntry);
+        elseBlock->codeGen(context);
+        BranchInst::Create(end, context.currentBlock());
+    }
+    enterBlock(context, end);
+    return NULL;
+}
+
+/* sayı values go through a switch instruction, LLVM lowers dense cases
+   to a jump table and sparse ones to a balanced tree of comparisons. yazı
+   values switch on strhash() of the string and compare it with the
+   literals of the matching hash. */
+Value* NSwitchStatement::codeGen(CodeGenContext& context)
+{
+    LOG(LogLevel::Verbose, "Creating switch statement");
+    LLVMContext& llvmContext = context.module->getContext();
+    Function *function = context.currentBlock()->getParent();
+    Value *subject = value->codeGen(context);
+    BasicBlock *end = BasicBlock::Create(llvmContext, "switch.end");
+    BasicBlock *otherwise = defaultBlock ? BasicBlock::Create(llvmContext, "switch.default") : end;
+    vector<BasicBlock *> targets;
+    for (size_t i = 0; i < cases.size(); i++)
+        targets.push_back(BasicBlock::Create(llvmContext, "switch.case"));
+
+    /* The type annotation of value is the one of the last specialization
+       checked, the type of the subject is the one of this code */
+    IRBuilder<> builder(context.currentBlock());
+    if (subject->getType() == Type::getInt8PtrTy(llvmContext)) {
+        /* Literals by their hash, with the case they belong to */
+        map<uint64_t, vector<pair<NString *, BasicBlock *>>> buckets;
+        for (size_t i = 0; i < cases.size(); i++) {
+            for (NExpression *literal : cases[i]->values) {
+                NString *str = static_cast<NString *>(literal);
+                buckets[strhash(str->value.data())].push_back(make_pair(str, targets[i]));
+            }
+        }
+        Value *hash = builder.CreateCall(context.strhashFunction, subject);
+        SwitchInst *dispatch = builder.CreateSwitch(hash, otherwise, buckets.size());
+        for (auto& bucket : buckets) {
+            BasicBlock *compare = BasicBlock::Create(llvmContext, "switch.hash", function);
+            dispatch->addCase(builder.getInt64(bucket.first), compare);
+            for (size_t i = 0; i < bucket.second.size(); i++) {
+                IRBuilder<> compareBuilder(compare);
+                Value *literal = compareBuilder.CreateGlobalStringPtr(bucket.second[i].first->value, ".str");
+                Value *order = compareBuilder.CreateCall(context.strcmpFunction, { subject, literal });
+                BasicBlock *next = i + 1 < bucket.second.size()
+                    ? BasicBlock::Create(llvmContext, "switch.hash", function) : otherwise;
+                compareBuilder.CreateCondBr(compareBuilder.CreateICmpEQ(order, compareBuilder.getInt32(0)),
+                                            bucket.second[i].second, next);
+                compare = next;
+            }
+        }
+    } else {
+        SwitchInst *dispatch = builder.CreateSwitch(subject, otherwise);
+        for (size_t i = 0; i < cases.size(); i++) {
+            for (NExpression *literal : cases[i]->values)
+                dispatch->addCase(builder.getInt64(static_cast<NInteger *>(literal)->value), targets[i]);
+        }
+    }
+
+    for (size_t i = 0; i < cases.size(); i++) {
+        enterBlock(context, targets[i]);
+        cases[i]->block.codeGen(context);
+        BranchInst::Create(end, context.currentBlock());
+    }
+    if (defaultBlock) {
+        enterBlock(context, otherwise);
+        defaultBlock->codeGen(context);
+        BranchInst::Create(end, context.currentBlock());
+    }
+    enterBlock(context, end);
+    return NULL;
+}
+
+static bool isNumeric(VariableType type)
+{
+    return type == VariableType::Integer || type == VariableType::Double;
+}
+
+static bool isVariable(NExpression& expr, const string& name)
+{
+    NReference *ref = dynamic_cast<NReference *>(&expr);
+    return ref && ref->refs.size() == 1 && ref->refs.front()->name == name;
+}
+
+/* Whether the code only does arithmetic on numeric locals, which the
+   vectorizer can handle. Adds the locals it assigns. */
+static bool isArithmetic(NExpression& expr, set<string>& assigned)
+{
+    if (dynamic_cast<NInteger *>(&expr) || dynamic_cast<NDouble *>(&expr))
+        return true;
+    if (NReference *ref = dynamic_cast<NReference *>(&expr))
+        return ref->refs.size() == 1 && isNumeric(expr.type);
+    if (NBinaryOperator *binary = dynamic_cast<NBinaryOperator *>(&expr))
+        return isArithmetic(binary->lhs, assigned) && isArithmetic(binary->rhs, assigned);
+    if (NAssignment *assignment = dynamic_cast<NAssignment *>(&expr)) {
+        if (assignment->lhs.refs.size() != 1 || !isNumeric(assignment->type)) return false;
+        assigned.insert(assignment->lhs.refs.front()->name.str());
+        return isArithmetic(assignment->rhs, assigned);
+    }
+    return false;
+}
+
+static bool isArithmetic(NBlock& block, set<string>& assigned)
+{
+    for (NStatement *statement : block.statements) {
+        if (NExpressionStatement *expr = dynamic_cast<NExpressionStatement *>(statement)) {
+            if (!isArithmetic(expr->expression, assigned)) return false;
+        } else if (NVariableDeclaration *decl = dynamic_cast<NVariableDeclaration *>(statement)) {
+            if (decl->assignmentExpr == NULL || !isNumeric(decl->assignmentExpr->type) ||
+                !isArithmetic(*decl->assignmentExpr, assigned))
+                return false;
+            assigned.insert(decl->id.name.str());
+        } else if (NIfStatement *ifStatement = dynamic_cast<NIfStatement *>(statement)) {
+            if (!isArithmetic(*ifStatement->condition, assigned) || !isArithmetic(ifStatement->thenBlock, assigned) ||
+                (ifStatement->elseBlock && !isArithmetic(*ifStatement->elseBlock, assigned)))
+                return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Iterations of a loop counting from first by stride while the
+   comparison with last holds, -1 when it never ends or overflows */
+static long long tripCount(long long first, int op, long long last, long long stride)
+{
+    long long distance;
+    if (stride < 0) {
+        if (__builtin_sub_overflow(first, last, &distance)) return -1;
+        stride = -stride;
+        op = op == TCGT ? TCLT : op == TCGE ? TCLE : op;
+    } else if (__builtin_sub_overflow(last, first, &distance)) {
+        return -1;
+    }
+    switch (op) {
+        case TCLT: return distance <= 0 ? 0 : distance / stride + (distance % stride != 0);
+        case TCLE: return distance < 0 ? 0 : distance / stride + 1;
+        case TCNE: return distance >= 0 && distance % stride == 0 ? distance / stride : -1;
+    }
+    return -1;
+}
+
+/* A çevrim is counted when it steps a sayı variable by a literal towards
+   a literal or a variable its body does not assign, and the body only
+   does arithmetic. The trip count is known when both ends are literals. */
+struct LoopHints {
+    bool counted;
+    long long tripCount;
+};
+
+static LoopHints loopHints(NLoopStatement& loop)
+{
+    LoopHints hints = { false, -1 };
+    if (loop.init == NULL || loop.condition == NULL || loop.step == NULL) return hints;
+
+    string name;
+    NExpression *start;
+    if (NVariableDeclaration *decl = dynamic_cast<NVariableDeclaration *>(loop.init)) {
+        if (decl->assignmentExpr == NULL) return hints;
+        name = decl->id.name.str();
+        start = decl->assignmentExpr;
+    } else if (NExpressionStatement *expr = dynamic_cast<NExpressionStatement *>(loop.init)) {
+        NAssignment *assignment = dynamic_cast<NAssignment *>(&expr->expression);
+        if (assignment == NULL || assignment->lhs.refs.size() != 1) return hints;
+        name = assignment->lhs.refs.front()->name.str();
+        start = &assignment->rhs;
+    } else {
+        return hints;
+    }
+    if (start->type != VariableType::Integer) return hints;
+
+    NAssignment *step = dynamic_cast<NAssignment *>(loop.step);
+    NBinaryOperator *increment = step ? dynamic_cast<NBinaryOperator *>(&step->rhs) : NULL;
+    NInteger *amount = increment ? dynamic_cast<NInteger *>(&increment->rhs) : NULL;
+    if (amount == NULL || amount->value <= 0 || !isVariable(step->lhs, name) || !isVariable(increment->lhs, name) ||
+        (increment->op != TPLUS && increment->op != TMINUS))
+        return hints;
+    long long stride = increment->op == TPLUS ? amount->value : -amount->value;
+
+    NBinaryOperator *compare = dynamic_cast<NBinaryOperator *>(loop.condition);
+    if (compare == NULL || !isVariable(compare->lhs, name)) return hints;
+    bool towards = compare->op == TCNE || (stride > 0 && (compare->op == TCLT || compare->op == TCLE)) ||
+                   (stride < 0 && (compare->op == TCGT || compare->op == TCGE));
+    set<string> assigned;
+    if (!towards || !isArithmetic(loop.block, assigned) || assigned.count(name)) return hints;
+    NInteger *last = dynamic_cast<NInteger *>(&compare->rhs);
+    NReference *bound = dynamic_cast<NReference *>(&compare->rhs);
+    if (last == NULL && (bound == NULL || bound->refs.size() != 1 || bound->type != VariableType::Integer ||
+                         assigned.count(bound->refs.front()->name.str())))
+        return hints;
+
+    hints.counted = true;
+    if (NInteger *first = dynamic_cast<NInteger *>(start)) {
+        if (last) hints.tripCount = tripCount(first->value, compare->op, last->value, stride);
+    }
+    return hints;
+}
+
+/* Loops of up to this many iterations are unrolled completely */
+static const long long FullUnrollTripCount = 16;
+
+/* Adds the llvm.loop hints of a counted loop to its latch: short loops
+   are unrolled, others vectorized and unrolled. The branch weights tell
+   the optimizer the trip count. */
+static void addLoopHints(CodeGenContext& context, BranchInst *latch, const LoopHints& hints)
+{
+    if (!hints.counted) return;
+    LLVMContext& llvmContext = context.module->getContext();
+    TempMDTuple self = MDNode::getTemporary(llvmContext, ArrayRef<Metadata*>());
+    vector<Metadata*> operands = { self.get() };
+    if (hints.tripCount >= 0 && hints.tripCount <= FullUnrollTripCount) {
+        operands.push_back(MDNode::get(llvmContext, MDString::get(llvmContext, "llvm.loop.unroll.full")));
+    } else {
+        Metadata *vectorize[] = { MDString::get(llvmContext, "llvm.loop.vectorize.enable"),
+                                  ConstantAsMetadata::get(ConstantInt::getTrue(llvmContext)) };
+        operands.push_back(MDNode::get(llvmContext, vectorize));
+        operands.push_back(MDNode::get(llvmContext, MDString::get(llvmContext, "llvm.loop.unroll.enable")));
+    }
+    MDNode *loopID = MDNode::get(llvmContext, operands);
+    loopID->replaceOperandWith(0, loopID);
+    latch->setMetadata(LLVMContext::MD_loop, loopID);
+    if (hints.tripCount > 1) {
+        uint32_t taken = min<long long>(hints.tripCount - 1, UINT32_MAX);
+        latch->setMetadata(LLVMContext::MD_prof, MDBuilder(llvmContext).createBranchWeights(taken, 1));
+    }
+    LOG(LogLevel::Verbose, "Counted loop, trip count " + to_string(hints.tripCount));
+}
+
+/* Loops are generated rotated: the condition is checked once before the
+   first iteration and then in the latch after every iteration, which
+   branches back to the body. atla continues with the latch. */
+Value* NLoopStatement::codeGen(CodeGenContext& context)
+{
+    LOG(LogLevel::Verbose, "Creating loop");
+    LLVMContext& llvmContext = context.module->getContext();
+    BasicBlock *body = BasicBlock::Create(llvmContext, "loop.body");
+    BasicBlock *latch = BasicBlock::Create(llvmContext, "loop.latch");
+    BasicBlock *end = BasicBlock::Create(llvmContext, "loop.end");
+    if (init) init->codeGen(context);
+    if (condition) branch(context, *condition, body, end);
+    else BranchInst::Create(body, context.currentBlock());
+
+    enterBlock(context, body);
+    context.loops().push_back(LoopTargets { end, latch });
+    block.codeGen(context);
+    context.loops().pop_back();
+    BranchInst::Create(latch, context.currentBlock());
+
+    enterBlock(context, latch);
+    if (step) step->codeGen(context);
+    BranchInst *backedge = condition ? branch(context, *condition, body, end)
+                                     : BranchInst::Create(body, context.currentBlock());
+    addLoopHints(context, backedge, loopHints(*this));
+    enterBlock(context, end);
+    return NULL;
+}
+
+Value* NBreakStatement::codeGen(CodeGenContext& context)
+{
+    jump(context, context.loops().back().breakBlock);
+    return NULL;
+}
+
+Value* NContinueStatement::codeGen(CodeGenContext& context)
+{
+    jump(context, context.loops().back().continueBlock);
+    return NULL;
+}
+
 Value* NVariableDeclaration::codeGen(CodeGenContext& context)
 {
-    LOG(LogLevel::Verbose, "Creating variable declaration " + to_string(type) + " " + id.name);
-    AllocaInst *alloc = new AllocaInst(typeOf(type, context), id.name.c_str(), context.currentBlock());
-    context.locals()[id.name] = alloc;
+    LOG(LogLevel::Verbose, "Creating variable declaration " + to_string(type) + " " + id.name.str());
+    if (type == VariableType::Any) {
+        /* herhangi variables take the type of their initial value */
+        Value *value = assignmentExpr->codeGen(context);
+        AllocaInst *alloc = context.createLocal(value->getType(), id.name.str());
+        new StoreInst(value, alloc, false, context.currentBlock());
+        context.locals()[id.name.str()] = alloc;
+        return alloc;
+    }
+    AllocaInst *alloc = context.createLocal(typeOf(type, context), id.name.str());
+    context.locals()[id.name.str()] = alloc;
     if (assignmentExpr != NULL) {
         NReference ref(id);
         NAssignment assn(ref, *assignmentExpr);
@@ -350,39 +1335,70 @@ Value* NExternDeclaration::codeGen(CodeGenContext& context)
         argTypes.push_back(typeOf((**it).type, context));
     }
     FunctionType *ftype = FunctionType::get(typeOf(type, context), makeArrayRef(argTypes), false);
-    Function *function = Function::Create(ftype, GlobalValue::ExternalLinkage, id.name.c_str(), context.module);
+    Function *function = Function::Create(ftype, GlobalValue::ExternalLinkage, id.name, context.module);
     return function;
 }
 
-Value* NFunctionDeclaration::codeGen(CodeGenContext& context)
+/* Generates the function for the types of its arguments, generic ones
+   once for every specialization */
+static Function *generateFunction(CodeGenContext& context, NFunctionDeclaration& decl, const string& name,
+                                  const vector<VariableType>& types, VariableType returnType)
 {
-    LOG(LogLevel::Verbose, id.name);
+    LOG(LogLevel::Verbose, name);
+    TRACE_SCOPE("codegen", "function", name);
     vector<Type*> argTypes;
-    VariableList::const_iterator it;
-    for (it = arguments.begin(); it != arguments.end(); it++) {
-        argTypes.push_back(typeOf((**it).type, context));
-    }
-    FunctionType *ftype = FunctionType::get(typeOf(type, context), makeArrayRef(argTypes), false);
-    Function *function = Function::Create(ftype, GlobalValue::InternalLinkage, id.name.c_str(), context.module);
+    for (VariableType type : types)
+        argTypes.push_back(typeOf(type, context));
+    FunctionType *ftype = FunctionType::get(typeOf(returnType, context), makeArrayRef(argTypes), false);
+    Function *function = Function::Create(ftype, GlobalValue::InternalLinkage, name, context.module);
     BasicBlock *bblock = BasicBlock::Create(context.module->getContext(), "entry", function, 0);
 
     context.pushBlock(bblock);
+    if (context.options.optLevel > 0)
+        context.localObjects() = findLocalObjects(decl);
+    /* Functions that end without döndür return zero or null */
+    BasicBlock *returnBlock = BasicBlock::Create(context.module->getContext(), "return");
+    AllocaInst *returnSlot = NULL;
+    if (!ftype->getReturnType()->isVoidTy()) {
+        returnSlot = new AllocaInst(ftype->getReturnType(), "result", bblock);
+        new StoreInst(Constant::getNullValue(ftype->getReturnType()), returnSlot, false, bblock);
+    }
+    context.setReturnBlock(returnBlock, returnSlot);
 
     Function::arg_iterator argsValues = function->arg_begin();
     Value* argumentValue;
 
-    for (it = arguments.begin(); it != arguments.end(); it++) {
-        (**it).codeGen(context);
+    for (size_t i = 0; i < decl.arguments.size(); i++) {
+        string argumentName = decl.arguments[i]->id.name.str();
+        AllocaInst *alloc = new AllocaInst(argTypes[i], argumentName.c_str(), bblock);
+        context.locals()[argumentName] = alloc;
 
         argumentValue = &*argsValues++;
-        argumentValue->setName((*it)->id.name.c_str());
-        StoreInst *inst = new StoreInst(argumentValue, context.locals()[(*it)->id.name], false, bblock);
+        argumentValue->setName(argumentName.c_str());
+        new StoreInst(argumentValue, alloc, false, bblock);
     }
 
-    block.codeGen(context);
-    ReturnInst::Create(context.module->getContext(), context.getCurrentReturnValue(), bblock);
+    decl.block.codeGen(context);
+    BranchInst::Create(returnBlock, context.currentBlock());
+    function->getBasicBlockList().push_back(returnBlock);
+    ReturnInst::Create(context.module->getContext(),
+        returnSlot ? new LoadInst(returnSlot, "", false, returnBlock) : NULL, returnBlock);
+    context.emitShadowStack(function);
 
     context.popBlock();
-    LOG(LogLevel::Verbose, "Creating function: " + id.name);
+    LOG(LogLevel::Verbose, "Creating function: " + name);
     return function;
 }
+
+Value* NFunctionDeclaration::codeGen(CodeGenContext& context)
+{
+    if (isGeneric()) {
+        /* Compiled for the types of each call, see specialize() */
+        context.genericFunctions[id.name.str()] = this;
+        return NULL;
+    }
+    vector<VariableType> types;
+    for (NVariableDeclaration *argument : arguments)
+        types.push_back(argument->type);
+    return generateFunction(context, *this, id.name.str(), types, type);
+}
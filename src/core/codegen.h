@@ -18,37 +18,105 @@
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/Support/CodeGen.h>
 #include "../logger.h"
+#include "../trace.h"
+#include "../options.h"
+#include "escape.h"
 
 using namespace llvm;
 
-static LLVMContext TheContext;
-
 class NBlock;
 
+/* Blocks çık and atla branch to in a loop */
+struct LoopTargets {
+    BasicBlock *breakBlock;
+    BasicBlock *continueBlock;
+};
+
 class CodeGenBlock {
 public:
     BasicBlock *block;
-    Value *returnValue;
+    /* döndür stores the value in the return slot, unless the function
+       returns nothing, and branches to the return block */
+    BasicBlock *returnBlock;
+    AllocaInst *returnSlot;
+    /* Loops around the code being generated, the innermost last */
+    std::vector<LoopTargets> loops;
     std::map<std::string, Value*> locals;
+    /* Objects whose slots are locals, the local of a.b is named "a.b" */
+    LocalObjects localObjects;
 };
 
 class CodeGenContext {
     std::stack<CodeGenBlock *> blocks;
     Function *mainFunction;
+    /* Every context compiles into an LLVMContext of its own, so
+       programs can be compiled on several threads at once */
+    std::unique_ptr<LLVMContext> llvmContext;
+    /* Globals holding the SymbolID of each slot name, set by sym.init */
+    std::map<std::string, GlobalVariable*> symbols;
+    Function *symbolInitFunction;
+
+    void declareRuntime();
+    void defineSymbolInit();
+    void declareGenericFunctions(NBlock& root);
 
 public:
+    CompilerOptions options;
     Value *cObject;
     Module *module;
     Function *objallocFunction;
+    /* Boxing of numbers and strings, see convert() in codegen.cpp */
+    Function *intallocFunction;
+    Function *dblallocFunction;
+    Function *strallocFunction;
+    Function *strlenFunction;
+    /* şartlıgir on yazı, see NSwitchStatement::codeGen() */
+    Function *strhashFunction;
+    Function *strcmpFunction;
     Function *putSlotFunction;
     Function *getSlotFunction;
     Function *newobjFunction;
-
-    CodeGenContext() {
-        module = new Module("main.ll", TheContext);
+    Function *internSymbolFunction;
+    Function *getSlotCachedFunction;
+    Function *putSlotCachedFunction;
+    Function *gcPushFrameFunction;
+    Function *gcPopFrameFunction;
+    Function *gcAllocationBufferFunction;
+    GlobalVariable *emptyShape;
+    /* Shapes of the boxes, see checkBox() in types.h */
+    GlobalVariable *integerShape;
+    GlobalVariable *doubleShape;
+    GlobalVariable *stringShape;
+    Function *checkBoxFunction;
+    /* Runtime error of sayı / 0, see divideIntegers() in codegen.cpp */
+    Function *divisionByZeroFunction;
+    /* Functions with herhangi types, specialized at their calls */
+    std::map<std::string, NFunctionDeclaration*> genericFunctions;
+    /* Allocation buffer of each function, loaded once on entry */
+    std::map<Function*, Value*> allocationBuffers;
+    ObjectCache *objectCache = NULL;
+    /* Set when a call has no function to call, see NMethodCall::codeGen */
+    bool failed = false;
+
+    /* Runtime types of the module, see declareRuntime() */
+    StructType *objectType;
+    PointerType *objectPointerType;
+    /* Boxed numbers and strings, struct cinteger, cdouble and cstring */
+    StructType *integerType;
+    StructType *doubleType;
+    StructType *stringType;
+    PointerType *stringPointerType;
+    StructType *inlineCacheType;
+
+    CodeGenContext(const CompilerOptions& options = CompilerOptions())
+        : llvmContext(new LLVMContext()), options(options) {
+        module = new Module("main.ll", *llvmContext);
     }
 
     StructType *addStructType(char *name, size_t numArgs, ...);
@@ -56,21 +124,51 @@ public:
     Function *addExternalFunction(char *name, FunctionType *ftype);
     Function *addFunction(char *name, FunctionType *ftype, void (^block)(BasicBlock *));
 
-    void generateCode(NBlock& root);
-    void runCode();
+    /* Global holding the SymbolID of a slot name */
+    GlobalVariable *symbol(const std::string& name);
+    Value *allocateObject();
+    /* Allocates a local in the entry block, so code in loops reuses it
+       and mem2reg can promote it */
+    AllocaInst *createLocal(Type *type, const std::string& name);
+    /* Roots the objects of the function, see shadowstack.cpp */
+    void emitShadowStack(Function *function);
+
+    bool generateCode(NBlock& root);
+    bool generateFunctions(NBlock& root);
+    bool optimize() { return optimize(*module); }
+    bool optimize(Module& target) const;
+    CodeGenOpt::Level codeGenOptLevel() const;
+    bool compileParallel(unsigned jobs, bool forJIT, std::vector<std::unique_ptr<MemoryBuffer>>& objects);
+    int runCode();
+    int runCodeLazily(TargetMachine *targetMachine);
+    int runObjects(std::vector<std::unique_ptr<MemoryBuffer>> objects);
+
+    bool emitObjectFile(const std::string& path);
+    bool emitLLVM(const std::string& path);
+    bool emitBitcode(const std::string& path);
 
     std::map<std::string, Value*>& locals() {
         return blocks.top()->locals;
     }
 
+    LocalObjects& localObjects() {
+        return blocks.top()->localObjects;
+    }
+
     BasicBlock *currentBlock() {
         return blocks.top()->block;
     }
 
+    /* Code generation continues in the block, e.g. after a branch */
+    void setCurrentBlock(BasicBlock *block) {
+        blocks.top()->block = block;
+    }
+
     void pushBlock(BasicBlock *block) {
         blocks.push(new CodeGenBlock());
-        blocks.top()->returnValue = NULL;
         blocks.top()->block = block;
+        blocks.top()->returnBlock = NULL;
+        blocks.top()->returnSlot = NULL;
     }
 
     void popBlock() {
@@ -79,13 +177,31 @@ public:
         delete top;
     }
 
-    void setCurrentReturnValue(Value *value) {
-        blocks.top()->returnValue = value;
+    void setReturnBlock(BasicBlock *block, AllocaInst *slot) {
+        blocks.top()->returnBlock = block;
+        blocks.top()->returnSlot = slot;
+    }
+
+    BasicBlock *returnBlock() {
+        return blocks.top()->returnBlock;
     }
 
-    Value *getCurrentReturnValue() {
-        return blocks.top()->returnValue;
+    AllocaInst *returnSlot() {
+        return blocks.top()->returnSlot;
+    }
+
+    std::vector<LoopTargets>& loops() {
+        return blocks.top()->loops;
     }
 };
 
+bool compileToObject(Module& module, raw_pwrite_stream& out, CodeGenOpt::Level level, bool forJIT);
+
+/* Instructions in the functions of the module, for the statistics */
+size_t countInstructions(const Module& module);
+/* Adds the machine code MCJIT loads to the statistics */
+JITEventListener *codeSizeListener();
+bool linkExecutable(const std::vector<std::string>& objectPaths, const std::string& outputPath,
+                    const std::string& runtimeLibrary);
+
 #endif // codegen_h
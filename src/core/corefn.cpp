@@ -1,6 +1,11 @@
 #include <iostream>
 #include "codegen.h"
 
+/* Bitcode of the core functions built once by cacheCoreFunctions, e.g. by
+   the compile server. Kept as bitcode since every CodeGenContext has an
+   LLVMContext of its own. */
+static std::string cachedCoreBitcode;
+
 Function* createPrintfFunction(CodeGenContext& context)
 {
     vector<Type*> printf_arg_types;
@@ -34,6 +39,7 @@ void createEchoIntegerFunction(CodeGenContext& context, Function* printfFn)
                 Twine("sayi_yaz"),
                 context.module
            );
+    func->addFnAttr(Attribute::AlwaysInline);
     BasicBlock *bblock = BasicBlock::Create(context.module->getContext(), "entry", func, 0);
     context.pushBlock(bblock);
 
@@ -81,6 +87,7 @@ void createEchoStringFunction(CodeGenContext& context, Function* printfFn)
                 Twine("yazi_yaz"),
                 context.module
            );
+    func->addFnAttr(Attribute::AlwaysInline);
     BasicBlock *bblock = BasicBlock::Create(context.module->getContext(), "entry", func, 0);
     context.pushBlock(bblock);
 
@@ -114,8 +121,32 @@ void createEchoStringFunction(CodeGenContext& context, Function* printfFn)
 }
 
 void createCoreFunctions(CodeGenContext& context){
+    TRACE_SCOPE("codegen", "coreFunctions");
+    if (!cachedCoreBitcode.empty()) {
+        LOG(LogLevel::Verbose, "Loading cached core functions");
+        ErrorOr<std::unique_ptr<Module>> core = parseBitcodeFile(
+            MemoryBufferRef(cachedCoreBitcode, "core"), context.module->getContext());
+        if (core) {
+            (*core)->setModuleIdentifier(context.module->getModuleIdentifier());
+            delete context.module;
+            context.module = core->release();
+            return;
+        }
+        LOG(LogLevel::Warning, "Invalid cached core functions: " + core.getError().message());
+    }
+
     LOG(LogLevel::Verbose, "Creating core functions");
     Function* printfFn = createPrintfFunction(context);
     createEchoIntegerFunction(context, printfFn);
     createEchoStringFunction(context, printfFn);
 }
+
+/* Builds the core functions once, contexts created later start from a copy */
+void cacheCoreFunctions(const CompilerOptions& options)
+{
+    CodeGenContext context(options);
+    createCoreFunctions(context);
+    raw_string_ostream out(cachedCoreBitcode);
+    WriteBitcodeToFile(context.module, out);
+    out.flush();
+}
@@ -0,0 +1,114 @@
+#include "codegen.h"
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <string>
+
+using namespace std;
+
+/* Compiles a module to a native object for the host target. Objects
+   loaded by the JIT use its code model, others are position independent. */
+bool compileToObject(Module& module, raw_pwrite_stream& out, CodeGenOpt::Level level, bool forJIT)
+{
+    TRACE_SCOPE("llvm", "compileToObject", module.getModuleIdentifier());
+    string triple = sys::getDefaultTargetTriple();
+    string error;
+    const Target *target = TargetRegistry::lookupTarget(triple, error);
+    if (target == NULL) {
+        LOG(LogLevel::Error, "Target lookup failed: " + error);
+        return false;
+    }
+
+    TargetOptions targetOptions;
+    unique_ptr<TargetMachine> tm(target->createTargetMachine(triple, sys::getHostCPUName(), "",
+        targetOptions, forJIT ? Reloc::Default : Reloc::PIC_,
+        forJIT ? CodeModel::JITDefault : CodeModel::Default, level));
+    module.setTargetTriple(triple);
+    module.setDataLayout(tm->createDataLayout());
+
+    legacy::PassManager pm;
+    if (tm->addPassesToEmitFile(pm, out, TargetMachine::CGFT_ObjectFile)) {
+        LOG(LogLevel::Error, "Target can not emit object files");
+        return false;
+    }
+    uint64_t start = out.tell();
+    pm.run(module);
+    out.flush();
+    if (Statistics::enabled())
+        Statistics::add(Counter::ObjectBytes, out.tell() - start);
+    return true;
+}
+
+/* Writes the module as a native object file for the host target */
+bool CodeGenContext::emitObjectFile(const string& path)
+{
+    LOG(LogLevel::Debug, "Emitting object file: " + path);
+    std::error_code ec;
+    raw_fd_ostream out(path, ec, sys::fs::F_None);
+    if (ec) {
+        LOG(LogLevel::Error, "Could not open " + path + ": " + ec.message());
+        return false;
+    }
+    return compileToObject(*module, out, codeGenOptLevel(), false);
+}
+
+/* Writes the module as human readable LLVM IR */
+bool CodeGenContext::emitLLVM(const string& path)
+{
+    LOG(LogLevel::Debug, "Emitting LLVM IR: " + path);
+    std::error_code ec;
+    raw_fd_ostream out(path, ec, sys::fs::F_Text);
+    if (ec) {
+        LOG(LogLevel::Error, "Could not open " + path + ": " + ec.message());
+        return false;
+    }
+    module->print(out, NULL);
+    return true;
+}
+
+/* Writes the module as LLVM bitcode */
+bool CodeGenContext::emitBitcode(const string& path)
+{
+    LOG(LogLevel::Debug, "Emitting bitcode: " + path);
+    std::error_code ec;
+    raw_fd_ostream out(path, ec, sys::fs::F_None);
+    if (ec) {
+        LOG(LogLevel::Error, "Could not open " + path + ": " + ec.message());
+        return false;
+    }
+    WriteBitcodeToFile(module, out);
+    return true;
+}
+
+/* Links emitted object files against the runtime library. The paths are
+   passed as arguments of the linker, no shell sees them. */
+bool linkExecutable(const vector<string>& objectPaths, const string& outputPath, const string& runtimeLibrary)
+{
+    ErrorOr<string> linker = sys::findProgramByName("c++");
+    if (!linker) {
+        LOG(LogLevel::Error, "No c++ in PATH to link " + outputPath);
+        return false;
+    }
+
+    vector<const char *> args = { "c++", "-o", outputPath.c_str() };
+    string command = *linker + " -o " + outputPath;
+    for (const string& object : objectPaths) {
+        args.push_back(object.c_str());
+        command += " " + object;
+    }
+    args.push_back(runtimeLibrary.c_str());
+    args.push_back(NULL);
+    command += " " + runtimeLibrary;
+    LOG(LogLevel::Debug, "Linking: " + command);
+
+    string error;
+    if (sys::ExecuteAndWait(*linker, args.data(), NULL, NULL, 0, 0, &error) != 0) {
+        LOG(LogLevel::Error, "Linking failed: " + outputPath + (error.empty() ? "" : ": " + error));
+        return false;
+    }
+    return true;
+}
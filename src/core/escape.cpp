@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <set>
+#include <typeinfo>
+#include "escape.h"
+#include "../logger.h"
+
+using namespace std;
+
+/* Walks the statements of one function. Names used as a value, assigned
+   to or declared escape, the others are local objects when they are used
+   as a.b at all. Nodes it does not know make every object escape. */
+class EscapeAnalysis {
+    map<string, vector<string>> accessed;
+    set<string> escaping;
+    bool complete;
+
+    void access(const NReference& ref) {
+        vector<string>& slots = accessed[ref.refs.front()->name.str()];
+        string slot = ref.refs[1]->name.str();
+        if (find(slots.begin(), slots.end(), slot) == slots.end())
+            slots.push_back(slot);
+    }
+
+    void giveUp(const string& reason) {
+        if (complete) LOG(LogLevel::Debug, "Escape analysis: " + reason);
+        complete = false;
+    }
+
+    void visitExpression(NExpression& expr) {
+        if (dynamic_cast<NInteger *>(&expr) || dynamic_cast<NDouble *>(&expr) || dynamic_cast<NString *>(&expr))
+            return;
+        if (NIdentifier *ident = dynamic_cast<NIdentifier *>(&expr)) {
+            escaping.insert(ident->name.str());
+            return;
+        }
+        if (NReference *ref = dynamic_cast<NReference *>(&expr)) {
+            if (ref->refs.size() == 1) escaping.insert(ref->refs.front()->name.str());
+            else access(*ref);
+            return;
+        }
+        if (NMethodCall *call = dynamic_cast<NMethodCall *>(&expr)) {
+            for (NExpression *argument : call->arguments)
+                visitExpression(*argument);
+            return;
+        }
+        if (NBinaryOperator *binary = dynamic_cast<NBinaryOperator *>(&expr)) {
+            visitExpression(binary->lhs);
+            visitExpression(binary->rhs);
+            return;
+        }
+        if (NAssignment *assignment = dynamic_cast<NAssignment *>(&expr)) {
+            /* a = x replaces the object a stands for */
+            if (assignment->lhs.refs.size() == 1) escaping.insert(assignment->lhs.refs.front()->name.str());
+            else access(assignment->lhs);
+            visitExpression(assignment->rhs);
+            return;
+        }
+        if (NBlock *block = dynamic_cast<NBlock *>(&expr)) {
+            visitBlock(*block);
+            return;
+        }
+        giveUp(string("unknown expression ") + typeid(expr).name());
+    }
+
+    void visitStatement(NStatement& stmt) {
+        if (NExpressionStatement *expr = dynamic_cast<NExpressionStatement *>(&stmt)) {
+            visitExpression(expr->expression);
+            return;
+        }
+        if (NReturnStatement *ret = dynamic_cast<NReturnStatement *>(&stmt)) {
+            visitExpression(ret->expression);
+            return;
+        }
+        if (NVariableDeclaration *decl = dynamic_cast<NVariableDeclaration *>(&stmt)) {
+            escaping.insert(decl->id.name.str());
+            if (decl->assignmentExpr != NULL) visitExpression(*decl->assignmentExpr);
+            return;
+        }
+        if (NIfStatement *ifStatement = dynamic_cast<NIfStatement *>(&stmt)) {
+            visitExpression(*ifStatement->condition);
+            visitBlock(ifStatement->thenBlock);
+            if (ifStatement->elseBlock) visitBlock(*ifStatement->elseBlock);
+            return;
+        }
+        if (NLoopStatement *loop = dynamic_cast<NLoopStatement *>(&stmt)) {
+            if (loop->init) visitStatement(*loop->init);
+            if (loop->condition) visitExpression(*loop->condition);
+            if (loop->step) visitExpression(*loop->step);
+            visitBlock(loop->block);
+            return;
+        }
+        if (NSwitchStatement *switchStatement = dynamic_cast<NSwitchStatement *>(&stmt)) {
+            visitExpression(*switchStatement->value);
+            for (NSwitchCase *switchCase : switchStatement->cases)
+                visitBlock(switchCase->block);
+            if (switchStatement->defaultBlock) visitBlock(*switchStatement->defaultBlock);
+            return;
+        }
+        if (dynamic_cast<NBreakStatement *>(&stmt) || dynamic_cast<NContinueStatement *>(&stmt))
+            return;
+        /* Declarations have scopes of their own */
+        if (dynamic_cast<NFunctionDeclaration *>(&stmt) || dynamic_cast<NExternDeclaration *>(&stmt))
+            return;
+        giveUp(string("unknown statement ") + typeid(stmt).name());
+    }
+
+public:
+    EscapeAnalysis() : complete(true) {
+        escaping.insert("null");
+    }
+
+    void declare(const string& name) {
+        escaping.insert(name);
+    }
+
+    void visitBlock(NBlock& block) {
+        for (NStatement *statement : block.statements)
+            visitStatement(*statement);
+    }
+
+    LocalObjects localObjects() {
+        LocalObjects objects;
+        if (!complete) return objects;
+        for (auto& entry : accessed) {
+            if (escaping.find(entry.first) == escaping.end())
+                objects.insert(entry);
+        }
+        return objects;
+    }
+};
+
+LocalObjects findLocalObjects(NBlock& program)
+{
+    EscapeAnalysis analysis;
+    analysis.visitBlock(program);
+    return analysis.localObjects();
+}
+
+LocalObjects findLocalObjects(NFunctionDeclaration& function)
+{
+    EscapeAnalysis analysis;
+    for (NVariableDeclaration *argument : function.arguments)
+        analysis.declare(argument->id.name.str());
+    analysis.visitBlock(function.block);
+    return analysis.localObjects();
+}
@@ -0,0 +1,20 @@
+#ifndef escape_h
+#define escape_h
+
+#include <map>
+#include <string>
+#include <vector>
+#include "node.h"
+
+/* Objects a function creates for unknown identifiers (NIdentifier::codeGen)
+   that never leave it: they are only used as a.b, never as a value that
+   could be stored into another object, returned or passed to a function.
+   Code generation keeps each of their slots in a local instead of
+   allocating them. Maps the name of every such object to its slots. */
+typedef std::map<std::string, std::vector<std::string>> LocalObjects;
+
+/* Local objects of the top level code, function declarations excluded */
+LocalObjects findLocalObjects(NBlock& program);
+LocalObjects findLocalObjects(NFunctionDeclaration& function);
+
+#endif // escape_h
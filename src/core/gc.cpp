@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+#include "gc.h"
+
+/* Objects live in blocks of cells of one size class. Allocation bumps a
+   cursor through a run of free cells, collections mark the objects
+   reachable from the roots and sweep the rest. Objects never move, the
+   generated code keeps their addresses in registers. */
+
+static const size_t BlockSize = 64 * 1024;
+static const size_t CellAlignment = GCCellAlignment;
+static const size_t SizeClassCount = GCMaxObjectSize / CellAlignment;
+static const size_t MaxCells = BlockSize / CellAlignment;
+static const size_t BitmapWords = MaxCells / 64;
+/* Bytes allocated before the first collection, later twice the live bytes */
+static const size_t InitialThreshold = 4 << 20;
+
+struct Block {
+	Block *next;
+	uint32_t cellSize;
+	uint32_t cellCount;
+	char *cells;
+	uint64_t allocated[BitmapWords];
+	uint64_t marked[BitmapWords];
+
+	bool test(const uint64_t *bits, size_t cell) const { return bits[cell / 64] & (1ULL << (cell % 64)); }
+	void set(uint64_t *bits, size_t cell) { bits[cell / 64] |= 1ULL << (cell % 64); }
+	void clear(uint64_t *bits, size_t cell) { bits[cell / 64] &= ~(1ULL << (cell % 64)); }
+};
+
+struct SizeClass : GCAllocationBuffer {
+	char *regionStart;   // start of the free run the cursor is in
+	Block *blocks;
+	Block *current;
+};
+
+struct Heap {
+	SizeClass sizeClasses[SizeClassCount];
+	std::unordered_set<Block *> blocks;
+	GCFrame *frames;
+	GCRootRange *ranges;
+	size_t allocatedBytes;  // since the last collection
+	size_t threshold;
+	std::vector<mObject *> markStack;
+
+	Heap() : frames(NULL), ranges(NULL), allocatedBytes(0), threshold(InitialThreshold) {
+		memset(sizeClasses, 0, sizeof(sizeClasses));
+	}
+	~Heap();
+
+	void *allocate(size_t size);
+	void collect();
+
+private:
+	bool refill(SizeClass& sizeClass, size_t cellSize);
+	bool nextRun(SizeClass& sizeClass);
+	void retireRegion(SizeClass& sizeClass);
+	Block *cellBlock(void *pointer);
+	void markPointer(void *pointer);
+	void trace(mObject *object);
+	size_t sweep();
+};
+
+static thread_local Heap heap;
+
+/* Frees the memory an object owns besides its cell */
+static void finalize(mObject *object)
+{
+	if (object->shape) delete[] object->overflow;
+	else delete object->dictionary;
+}
+
+Heap::~Heap()
+{
+	for (Block *block : blocks) {
+		for (size_t i = 0; i < block->cellCount; i++) {
+			if (block->test(block->allocated, i))
+				finalize((mObject *) (block->cells + i * block->cellSize));
+		}
+		free(block);
+	}
+}
+
+/* Marks the cells handed out from the current run as allocated */
+void Heap::retireRegion(SizeClass& sizeClass)
+{
+	if (sizeClass.current == NULL) return;
+	Block *block = sizeClass.current;
+	for (char *cell = sizeClass.regionStart; cell < sizeClass.cursor; cell += block->cellSize)
+		block->set(block->allocated, (cell - block->cells) / block->cellSize);
+	sizeClass.regionStart = sizeClass.cursor;
+}
+
+/* Moves the cursor to the next run of free cells of the size class */
+bool Heap::nextRun(SizeClass& sizeClass)
+{
+	for (; sizeClass.current; sizeClass.current = sizeClass.current->next, sizeClass.limit = NULL) {
+		Block *block = sizeClass.current;
+		size_t cell = sizeClass.limit ? (sizeClass.limit - block->cells) / block->cellSize : 0;
+		while (cell < block->cellCount && block->test(block->allocated, cell))
+			cell++;
+		if (cell == block->cellCount) continue;
+		size_t end = cell;
+		while (end < block->cellCount && !block->test(block->allocated, end))
+			end++;
+		sizeClass.regionStart = sizeClass.cursor = block->cells + cell * block->cellSize;
+		sizeClass.limit = block->cells + end * block->cellSize;
+		allocatedBytes += (end - cell) * block->cellSize;
+		return true;
+	}
+	return false;
+}
+
+bool Heap::refill(SizeClass& sizeClass, size_t cellSize)
+{
+	retireRegion(sizeClass);
+	if (nextRun(sizeClass)) return true;
+
+	if (allocatedBytes >= threshold) {
+		collect();
+		sizeClass.current = sizeClass.blocks;
+		if (nextRun(sizeClass)) return true;
+	}
+
+	void *memory = NULL;
+	if (posix_memalign(&memory, BlockSize, BlockSize) != 0)
+		return false;
+	Block *block = (Block *) memory;
+	memset(block->allocated, 0, sizeof(block->allocated));
+	memset(block->marked, 0, sizeof(block->marked));
+	block->cellSize = cellSize;
+	size_t header = (sizeof(Block) + CellAlignment - 1) / CellAlignment * CellAlignment;
+	block->cells = (char *) block + header;
+	block->cellCount = (BlockSize - header) / cellSize;
+	/* Appended, so the full blocks before it are not scanned again */
+	Block **link = &sizeClass.blocks;
+	while (*link) link = &(*link)->next;
+	block->next = NULL;
+	*link = block;
+	blocks.insert(block);
+
+	sizeClass.current = block;
+	sizeClass.limit = NULL;
+	return nextRun(sizeClass);
+}
+
+void *Heap::allocate(size_t size)
+{
+	size_t cellSize = gcCellSize(size);
+	if (cellSize > GCMaxObjectSize) abort();
+	SizeClass& sizeClass = sizeClasses[cellSize / CellAlignment - 1];
+	if ((size_t) (sizeClass.limit - sizeClass.cursor) < cellSize) {
+		if (!refill(sizeClass, cellSize)) abort();
+	}
+	void *cell = sizeClass.cursor;
+	sizeClass.cursor += cellSize;
+	memset(cell, 0, cellSize);
+	return cell;
+}
+
+/* Returns the block of an allocated cell, or NULL for other pointers */
+Block *Heap::cellBlock(void *pointer)
+{
+	Block *block = (Block *) ((uintptr_t) pointer & ~(uintptr_t) (BlockSize - 1));
+	if (blocks.find(block) == blocks.end()) return NULL;
+	char *cell = (char *) pointer;
+	if (cell < block->cells || cell >= block->cells + block->cellCount * block->cellSize) return NULL;
+	size_t offset = cell - block->cells;
+	if (offset % block->cellSize != 0 || !block->test(block->allocated, offset / block->cellSize)) return NULL;
+	return block;
+}
+
+void Heap::markPointer(void *pointer)
+{
+	if (pointer == NULL) return;
+	Block *block = cellBlock(pointer);
+	if (block == NULL) return;
+	size_t cell = ((char *) pointer - block->cells) / block->cellSize;
+	if (block->test(block->marked, cell)) return;
+	block->set(block->marked, cell);
+	markStack.push_back((mObject *) pointer);
+}
+
+void Heap::trace(mObject *object)
+{
+	markPointer(object->prototype);
+	if (object->shape) {
+		for (uint32_t i = 0; i < object->shape->slotCount; i++)
+			markPointer(*slotAddress(object, i));
+	} else {
+		for (auto& entry : *object->dictionary)
+			markPointer(entry.second);
+	}
+}
+
+/* Frees the unmarked objects, returns the bytes reclaimed */
+size_t Heap::sweep()
+{
+	size_t reclaimed = 0, live = 0;
+	for (SizeClass& sizeClass : sizeClasses) {
+		Block **link = &sizeClass.blocks;
+		while (Block *block = *link) {
+			size_t cells = 0;
+			for (size_t word = 0; word < BitmapWords; word++) {
+				uint64_t garbage = block->allocated[word] & ~block->marked[word];
+				cells += __builtin_popcountll(block->marked[word]);
+				block->allocated[word] = block->marked[word];
+				for (; garbage; garbage &= garbage - 1) {
+					size_t cell = word * 64 + __builtin_ctzll(garbage);
+					finalize((mObject *) (block->cells + cell * block->cellSize));
+					reclaimed += block->cellSize;
+				}
+			}
+			memset(block->marked, 0, sizeof(block->marked));
+			live += cells * block->cellSize;
+			if (cells == 0) {
+				*link = block->next;
+				blocks.erase(block);
+				free(block);
+			} else {
+				link = &block->next;
+			}
+		}
+		sizeClass.current = NULL;
+		sizeClass.cursor = sizeClass.limit = sizeClass.regionStart = NULL;
+	}
+	threshold = std::max(InitialThreshold, 2 * live);
+	allocatedBytes = 0;
+	return reclaimed;
+}
+
+void Heap::collect()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (SizeClass& sizeClass : sizeClasses)
+		retireRegion(sizeClass);
+
+	for (GCFrame *frame = frames; frame; frame = frame->previous) {
+		for (uint64_t i = 0; i < frame->count; i++)
+			markPointer(frame->roots[i]);
+	}
+	for (GCRootRange *range = ranges; range; range = range->previous) {
+		for (void **word = range->begin; word < range->end; word++)
+			markPointer(*word);
+	}
+	while (!markStack.empty()) {
+		mObject *object = markStack.back();
+		markStack.pop_back();
+		trace(object);
+	}
+	size_t reclaimed = sweep();
+
+	if (runtimeCounters.enabled.load(std::memory_order_relaxed)) {
+		uint64_t pause = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		runtimeCounters.gcCollections++;
+		runtimeCounters.gcPauseMicros += pause;
+		runtimeCounters.gcBytesReclaimed += reclaimed;
+		uint64_t longest = runtimeCounters.gcMaxPauseMicros;
+		while (pause > longest && !runtimeCounters.gcMaxPauseMicros.compare_exchange_weak(longest, pause))
+			;
+	}
+}
+
+extern "C" {
+
+void gcPushFrame(GCFrame *frame)
+{
+	frame->previous = heap.frames;
+	heap.frames = frame;
+}
+
+void gcPopFrame(GCFrame *frame)
+{
+	heap.frames = frame->previous;
+}
+
+void *gcAllocate(size_t size)
+{
+	return heap.allocate(size);
+}
+
+void gcCollect()
+{
+	heap.collect();
+}
+
+GCAllocationBuffer *gcAllocationBuffer(size_t size)
+{
+	return &heap.sizeClasses[gcCellSize(size) / CellAlignment - 1];
+}
+
+}
+
+void gcPushRootRange(GCRootRange *range)
+{
+	range->previous = heap.ranges;
+	heap.ranges = range;
+}
+
+void gcPopRootRange(GCRootRange *range)
+{
+	heap.ranges = range->previous;
+}
@@ -0,0 +1,57 @@
+#ifndef gc_h
+#define gc_h
+
+#include <cstddef>
+#include <cstdint>
+#include "types.h"
+
+/* Frame of the shadow stack. Generated code keeps the objects a function
+   holds across calls that can collect in one, see
+   CodeGenContext::emitShadowStack, so the collector finds its roots
+   precisely. */
+struct GCFrame {
+	GCFrame *previous;
+	uint64_t count;
+	mObject *roots[1];
+};
+
+/* Memory scanned conservatively for roots, e.g. interpreter registers.
+   Words pointing to the start of an object keep it alive. */
+struct GCRootRange {
+	void **begin;
+	void **end;
+	GCRootRange *previous;
+};
+
+/* Free run of cells one size class allocates from. Generated code bumps
+   the cursor itself and calls objalloc when the run is used up. */
+struct GCAllocationBuffer {
+	char *cursor;
+	char *limit;
+};
+
+/* Every thread has a heap of its own: objects are only reachable from
+   the thread that created them, so a collection never stops others. */
+extern "C" {
+void gcPushFrame(GCFrame *frame);
+void gcPopFrame(GCFrame *frame);
+/* Allocates an object of up to GCMaxObjectSize bytes, may collect */
+void *gcAllocate(size_t size);
+void gcCollect();
+/* Allocation buffer of the calling thread for objects of the size */
+GCAllocationBuffer *gcAllocationBuffer(size_t size);
+}
+
+#define GCMaxObjectSize 256
+#define GCCellAlignment 16
+
+/* Size of the cells objects of the size are allocated in */
+static inline size_t gcCellSize(size_t size)
+{
+	return size ? (size + GCCellAlignment - 1) / GCCellAlignment * GCCellAlignment : GCCellAlignment;
+}
+
+void gcPushRootRange(GCRootRange *range);
+void gcPopRootRange(GCRootRange *range);
+
+#endif // gc_h
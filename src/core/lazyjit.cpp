@@ -0,0 +1,80 @@
+#include <iostream>
+#include "lazyjit.h"
+#include "../logger.h"
+#include <llvm/ExecutionEngine/Orc/LambdaResolver.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <set>
+
+using namespace llvm;
+using namespace std;
+
+LazyJIT::LazyJIT(TargetMachine *targetMachine)
+    : targetMachine(targetMachine),
+      dataLayout(targetMachine->createDataLayout()),
+      compileLayer(objectLayer, orc::SimpleCompiler(*targetMachine)),
+      callbackManager(0),
+      codLayer(compileLayer,
+               [](Function &function) -> set<Function*> {
+                   /* Every function is compiled on its own, on its first call */
+                   LOG(LogLevel::Debug, "Lazily compiling: " + function.getName().str());
+                   set<Function*> partition;
+                   partition.insert(&function);
+                   return partition;
+               },
+               callbackManager,
+               []() { return llvm::make_unique<orc::LocalIndirectStubsManager<orc::OrcX86_64>>(); })
+{
+    sys::DynamicLibrary::LoadLibraryPermanently(NULL);
+}
+
+bool LazyJIT::isSupported(const TargetMachine& targetMachine)
+{
+    return targetMachine.getTargetTriple().getArch() == Triple::x86_64;
+}
+
+string LazyJIT::mangle(const string& name)
+{
+    string mangledName;
+    raw_string_ostream stream(mangledName);
+    Mangler::getNameWithPrefix(stream, name, dataLayout);
+    return stream.str();
+}
+
+void LazyJIT::addModule(unique_ptr<Module> module)
+{
+    module->setDataLayout(dataLayout);
+
+    /* Functions end up in separate partitions, so they have to
+       reference each other and the module's globals by name */
+    for (Function& function : *module) {
+        if (function.hasLocalLinkage())
+            function.setLinkage(GlobalValue::ExternalLinkage);
+    }
+    for (GlobalVariable& global : module->globals()) {
+        if (global.hasLocalLinkage())
+            global.setLinkage(GlobalValue::ExternalLinkage);
+    }
+
+    /* Symbols are looked up in the JIT first, then in the compiler process */
+    auto resolver = orc::createLambdaResolver(
+        [this](const string& name) -> RuntimeDyld::SymbolInfo {
+            if (orc::JITSymbol symbol = codLayer.findSymbol(name, false))
+                return RuntimeDyld::SymbolInfo(symbol.getAddress(), symbol.getFlags());
+            if (uint64_t address = RTDyldMemoryManager::getSymbolAddressInProcess(name))
+                return RuntimeDyld::SymbolInfo(address, JITSymbolFlags::Exported);
+            return RuntimeDyld::SymbolInfo(nullptr);
+        },
+        [](const string& name) -> RuntimeDyld::SymbolInfo {
+            return RuntimeDyld::SymbolInfo(nullptr);
+        });
+
+    vector<unique_ptr<Module>> modules;
+    modules.push_back(move(module));
+    codLayer.addModuleSet(move(modules), llvm::make_unique<SectionMemoryManager>(), move(resolver));
+}
+
+orc::JITSymbol LazyJIT::findSymbol(const string& name)
+{
+    return codLayer.findSymbol(mangle(name), true);
+}
@@ -0,0 +1,40 @@
+#ifndef lazyjit_h
+#define lazyjit_h
+
+#include <memory>
+#include <string>
+#include <llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/Orc/OrcArchitectureSupport.h>
+#include <llvm/IR/Mangler.h>
+#include <llvm/Target/TargetMachine.h>
+
+/* ORC based JIT which compiles every function of a module on its first
+   call through a stub, instead of compiling the whole module up front. */
+class LazyJIT {
+    typedef llvm::orc::ObjectLinkingLayer<> ObjectLayer;
+    typedef llvm::orc::IRCompileLayer<ObjectLayer> CompileLayer;
+    typedef llvm::orc::CompileOnDemandLayer<CompileLayer> CODLayer;
+
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+    const llvm::DataLayout dataLayout;
+    ObjectLayer objectLayer;
+    CompileLayer compileLayer;
+    llvm::orc::LocalJITCompileCallbackManager<llvm::orc::OrcX86_64> callbackManager;
+    CODLayer codLayer;
+
+    std::string mangle(const std::string& name);
+
+public:
+    LazyJIT(llvm::TargetMachine *targetMachine);
+
+    /* Lazy compilation stubs are only implemented for x86-64 */
+    static bool isSupported(const llvm::TargetMachine& targetMachine);
+
+    void addModule(std::unique_ptr<llvm::Module> module);
+    llvm::orc::JITSymbol findSymbol(const std::string& name);
+};
+
+#endif // lazyjit_h
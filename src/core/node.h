@@ -2,19 +2,25 @@
 #define node_h
 
 #include <iostream>
+#include <map>
 #include <vector>
+#include <llvm/ADT/StringRef.h>
 #include <llvm/IR/Value.h>
+#include "arena.h"
+#include "../stats.h"
 
 class CodeGenContext;
 class NStatement;
 class NExpression;
 class NVariableDeclaration;
 class NIdentifier;
+class NSwitchCase;
 
-typedef std::vector<NStatement*> StatementList;
-typedef std::vector<NExpression*> ExpressionList;
-typedef std::vector<NIdentifier*> IdentifierList;
-typedef std::vector<NVariableDeclaration*> VariableList;
+typedef std::vector<NStatement*, ArenaAllocator<NStatement*>> StatementList;
+typedef std::vector<NExpression*, ArenaAllocator<NExpression*>> ExpressionList;
+typedef std::vector<NIdentifier*, ArenaAllocator<NIdentifier*>> IdentifierList;
+typedef std::vector<NVariableDeclaration*, ArenaAllocator<NVariableDeclaration*>> VariableList;
+typedef std::vector<NSwitchCase*, ArenaAllocator<NSwitchCase*>> CaseList;
 
 enum VariableType {
     Bool,
@@ -22,16 +28,47 @@ enum VariableType {
     Double,
     String,
     Object,
-    Void
+    Void,
+    Any         // herhangi, parameters of generic functions
 };
 
 class Node {
 public:
-    virtual ~Node() {}
     virtual llvm::Value* codeGen(CodeGenContext& context) { return NULL; }
+
+    /* Nodes created while parsing are allocated in the parser's arena and
+       freed with it. Their lists and text are in the arena too, so they
+       have no destructor to run and no header in front of them; see
+       NFunctionDeclaration for the exception. The few nodes created
+       outside of parsing live on the heap until the program exits. */
+    static void *operator new(size_t size) {
+        Arena *arena = Arena::current();
+        if (Statistics::enabled())
+            Statistics::add(Counter::ASTNodes, 1);
+        return arena ? arena->allocate(size, alignof(Node)) : ::operator new(size);
+    }
+
+    /* Nodes are never deleted one by one */
+    static void operator delete(void *node) { }
+
+protected:
+    /* Copies the text of a token next to the node, NUL terminated for
+       the C string functions of the runtime */
+    static llvm::StringRef copyText(llvm::StringRef text) {
+        Arena *arena = Arena::current();
+        if (arena)
+            return llvm::StringRef(arena->copy(text.data(), text.size()), text.size());
+        char *copy = new char[text.size() + 1];
+        memcpy(copy, text.data(), text.size());
+        copy[text.size()] = '\0';
+        return llvm::StringRef(copy, text.size());
+    }
 };
 
 class NExpression : public Node {
+public:
+    /* Static type, assigned by checkTypes() of typecheck.h */
+    VariableType type = VariableType::Void;
 };
 
 class NStatement : public Node {
@@ -53,15 +90,15 @@ public:
 
 class NIdentifier : public NExpression {
 public:
-    std::string name;
-    NIdentifier(const std::string& name) : name(name) { }
+    llvm::StringRef name;
+    NIdentifier(llvm::StringRef name) : name(copyText(name)) { }
     virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
 class NString : public NExpression {
 public:
-    std::string value;
-    NString(const std::string& value) : value(value) { }
+    llvm::StringRef value;
+    NString(llvm::StringRef value) : value(copyText(value)) { }
     virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
@@ -125,6 +162,64 @@ public:
     virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
+/* eğer (condition) { ... } yoksa { ... }, without a yoksa block when
+   elseBlock is NULL. Numbers other than zero are true. */
+class NIfStatement : public NStatement {
+public:
+    NExpression *condition;
+    NBlock& thenBlock;
+    NBlock *elseBlock;
+    NIfStatement(NExpression *condition, NBlock& thenBlock, NBlock *elseBlock = NULL) :
+        condition(condition), thenBlock(thenBlock), elseBlock(elseBlock) { }
+    virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
+/* çevrim (init, condition, step) { ... }. sürece (condition) { ... } has
+   no init and step, döngü { ... } no condition either. */
+class NLoopStatement : public NStatement {
+public:
+    NStatement *init;
+    NExpression *condition;
+    NExpression *step;
+    NBlock& block;
+    NLoopStatement(NStatement *init, NExpression *condition, NExpression *step, NBlock& block) :
+        init(init), condition(condition), step(step), block(block) { }
+    virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
+/* durum 1, 2 { ... } in a şartlıgir, the values are literals */
+class NSwitchCase : public Node {
+public:
+    ExpressionList values;
+    NBlock& block;
+    NSwitchCase(const ExpressionList& values, NBlock& block) :
+        values(values), block(block) { }
+};
+
+/* şartlıgir (value) { durum ... { ... } kabul { ... } } runs the block of
+   the case matching the sayı or yazı value, or the kabul block when none
+   does. Cases do not fall through, çık and atla refer to loops. */
+class NSwitchStatement : public NStatement {
+public:
+    NExpression *value;
+    CaseList cases;
+    NBlock *defaultBlock;
+    NSwitchStatement() : value(NULL), defaultBlock(NULL) { }
+    virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
+/* çık, leaves the innermost loop */
+class NBreakStatement : public NStatement {
+public:
+    virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
+/* atla, continues with the next iteration of the innermost loop */
+class NContinueStatement : public NStatement {
+public:
+    virtual llvm::Value* codeGen(CodeGenContext& context);
+};
+
 class NVariableDeclaration : public NStatement {
 public:
     const VariableType type;
@@ -153,10 +248,26 @@ public:
     const NIdentifier& id;
     VariableList arguments;
     NBlock& block;
+    /* Return type of each specialization of a generic function for the
+       types of its arguments, inferred by checkTypes(). The map is on the
+       heap, so a declaration in an arena is destroyed with it. */
+    std::map<std::vector<VariableType>, VariableType> specializations;
     NFunctionDeclaration(const VariableType type, const NIdentifier& id,
                          const VariableList& arguments, NBlock& block) :
                          type(type), id(id), arguments(arguments), block(block)
-    { }
+    {
+        if (Arena *arena = Arena::current())
+            arena->destroyOnRelease(this);
+    }
+    /* Functions with herhangi arguments or return type are compiled once
+       for every combination of argument types they are called with */
+    bool isGeneric() const {
+        if (type == VariableType::Any) return true;
+        for (NVariableDeclaration *argument : arguments) {
+            if (argument->type == VariableType::Any) return true;
+        }
+        return false;
+    }
     virtual llvm::Value* codeGen(CodeGenContext& context);
 };
 
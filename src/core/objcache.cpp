@@ -0,0 +1,110 @@
+#include <iostream>
+#include "objcache.h"
+#include "types.h"
+#include "../logger.h"
+#include "../stats.h"
+#include "../trace.h"
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/raw_ostream.h>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+using namespace llvm;
+using namespace std;
+
+DiskObjectCache::DiskObjectCache(const string& directory, StringRef source,
+                                 const CompilerOptions& options) : directory(directory)
+{
+    /* Everything that changes the generated machine code is part of the key */
+    string salt = string(COMPILER_VERSION) + '\0' + to_string(RUNTIME_ABI_VERSION) + '\0' +
+        to_string(sizeof(mObject)) + '\0' + LLVM_VERSION_STRING + '\0' +
+        sys::getProcessTriple() + '\0' + sys::getHostCPUName().str() + '\0' +
+        to_string(options.optLevel) + '\0' + options.passes + '\0' + to_string(Statistics::enabled());
+    MD5 hash;
+    hash.update(source);
+    hash.update(salt);
+
+    MD5::MD5Result result;
+    hash.final(result);
+    SmallString<32> hex;
+    MD5::stringifyResult(result, hex);
+    key = hex.str();
+
+    sys::fs::create_directories(directory);
+}
+
+string DiskObjectCache::objectPath() const
+{
+    return directory + "/" + key + ".o";
+}
+
+unique_ptr<MemoryBuffer> DiskObjectCache::lookup()
+{
+    TRACE_SCOPE("cache", "lookup");
+    ErrorOr<unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(objectPath(), -1, false);
+    if (!buffer) {
+        misses++;
+        LOG(LogLevel::Debug, "Code cache miss: " + key);
+        return NULL;
+    }
+    hits++;
+    LOG(LogLevel::Debug, "Code cache hit: " + key);
+    return move(*buffer);
+}
+
+void DiskObjectCache::notifyObjectCompiled(const Module *module, MemoryBufferRef object)
+{
+    /* Write to a private file first so concurrent runs never see a partial object */
+    string path = objectPath();
+    string temporary = path + ".tmp" + to_string(getpid());
+    std::error_code ec;
+    raw_fd_ostream out(temporary, ec, sys::fs::F_None);
+    if (ec) {
+        LOG(LogLevel::Warning, "Could not write code cache: " + ec.message());
+        return;
+    }
+    out << object.getBuffer();
+    out.close();
+    if (sys::fs::rename(temporary, path))
+        sys::fs::remove(temporary);
+}
+
+unique_ptr<MemoryBuffer> DiskObjectCache::getObject(const Module *module)
+{
+    ErrorOr<unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(objectPath(), -1, false);
+    if (!buffer) return NULL;
+    return MemoryBuffer::getMemBufferCopy((*buffer)->getBuffer());
+}
+
+/* The counters are read and rewritten under an exclusive lock of the
+   file, so concurrent runs do not lose each other's counts */
+void DiskObjectCache::reportStatistics()
+{
+    string path = directory + "/stats";
+    unsigned long totalHits = 0, totalMisses = 0;
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    FILE *file = NULL;
+    if (fd >= 0 && (flock(fd, LOCK_EX) != 0 || (file = fdopen(fd, "r+")) == NULL))
+        close(fd);
+    if (file && fscanf(file, "%lu %lu", &totalHits, &totalMisses) != 2)
+        totalHits = totalMisses = 0;
+    totalHits += hits;
+    totalMisses += misses;
+    if (file) {
+        rewind(file);
+        fprintf(file, "%lu %lu\n", totalHits, totalMisses);
+        fflush(file);
+        if (ftruncate(fd, ftell(file)) != 0)
+            LOG(LogLevel::Warning, "Could not truncate " + path);
+        /* Closing the file releases the lock */
+        fclose(file);
+    }
+
+    LOG(LogLevel::Info, "Code cache " + string(hits ? "hit" : "miss") +
+        " (total hits: " + to_string(totalHits) + ", misses: " + to_string(totalMisses) + ")");
+}
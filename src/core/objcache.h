@@ -0,0 +1,36 @@
+#ifndef objcache_h
+#define objcache_h
+
+#include <string>
+#include <memory>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include "../options.h"
+
+/* Stores objects compiled by MCJIT in a directory, keyed by a hash of the
+   program source, the compiler version and the code generation options,
+   so an unchanged program can skip parsing and code generation. */
+class DiskObjectCache : public llvm::ObjectCache {
+    std::string directory;
+    std::string key;
+    unsigned hits = 0;
+    unsigned misses = 0;
+
+    std::string objectPath() const;
+
+public:
+    DiskObjectCache(const std::string& directory, llvm::StringRef source,
+                    const CompilerOptions& options);
+
+    /* Returns the cached object of the program or null on a miss */
+    std::unique_ptr<llvm::MemoryBuffer> lookup();
+
+    void notifyObjectCompiled(const llvm::Module *module, llvm::MemoryBufferRef object) override;
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *module) override;
+
+    /* Adds this run to the counters kept in the cache directory and prints them */
+    void reportStatistics();
+};
+
+#endif // objcache_h
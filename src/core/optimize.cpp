@@ -0,0 +1,132 @@
+#include "codegen.h"
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/DiagnosticPrinter.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/Vectorize.h>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+struct PassEntry {
+    const char *name;
+    Pass *(*create)(unsigned optLevel);
+};
+
+/* Passes that can be given with -passes= */
+static const PassEntry PassTable[] = {
+    { "mem2reg",        [](unsigned) -> Pass * { return createPromoteMemoryToRegisterPass(); } },
+    { "sroa",           [](unsigned) -> Pass * { return createSROAPass(); } },
+    { "early-cse",      [](unsigned) -> Pass * { return createEarlyCSEPass(); } },
+    { "instcombine",    [](unsigned) -> Pass * { return createInstructionCombiningPass(); } },
+    { "reassociate",    [](unsigned) -> Pass * { return createReassociatePass(); } },
+    { "gvn",            [](unsigned) -> Pass * { return createGVNPass(); } },
+    { "sccp",           [](unsigned) -> Pass * { return createSCCPPass(); } },
+    { "dse",            [](unsigned) -> Pass * { return createDeadStoreEliminationPass(); } },
+    { "adce",           [](unsigned) -> Pass * { return createAggressiveDCEPass(); } },
+    { "simplifycfg",    [](unsigned) -> Pass * { return createCFGSimplificationPass(); } },
+    { "always-inline",  [](unsigned) -> Pass * { return createAlwaysInlinerPass(); } },
+    { "inline",         [](unsigned level) -> Pass * { return createFunctionInliningPass(level, 0); } },
+    { "ipsccp",         [](unsigned) -> Pass * { return createIPSCCPPass(); } },
+    { "deadargelim",    [](unsigned) -> Pass * { return createDeadArgEliminationPass(); } },
+    { "globalopt",      [](unsigned) -> Pass * { return createGlobalOptimizerPass(); } },
+    { "globaldce",      [](unsigned) -> Pass * { return createGlobalDCEPass(); } },
+    { "loop-rotate",    [](unsigned) -> Pass * { return createLoopRotatePass(); } },
+    { "licm",           [](unsigned) -> Pass * { return createLICMPass(); } },
+    { "indvars",        [](unsigned) -> Pass * { return createIndVarSimplifyPass(); } },
+    { "loop-idiom",     [](unsigned) -> Pass * { return createLoopIdiomPass(); } },
+    { "loop-deletion",  [](unsigned) -> Pass * { return createLoopDeletionPass(); } },
+    { "loop-unroll",    [](unsigned) -> Pass * { return createLoopUnrollPass(); } },
+    { "loop-vectorize", [](unsigned) -> Pass * { return createLoopVectorizePass(); } },
+    { "slp-vectorizer", [](unsigned) -> Pass * { return createSLPVectorizerPass(); } },
+};
+
+/* Default pipelines of -O1, -O2 and -O3 */
+static const char *O1Pipeline =
+    "mem2reg,instcombine,simplifycfg,always-inline,globaldce";
+static const char *O2Pipeline =
+    "mem2reg,instcombine,simplifycfg,inline,sroa,early-cse,instcombine,"
+    "reassociate,gvn,sccp,simplifycfg,loop-rotate,licm,indvars,loop-idiom,"
+    "loop-deletion,loop-unroll,loop-vectorize,instcombine,dse,adce,simplifycfg,globaldce";
+static const char *O3Pipeline =
+    "ipsccp,globalopt,deadargelim,mem2reg,instcombine,simplifycfg,inline,sroa,"
+    "early-cse,instcombine,reassociate,gvn,sccp,simplifycfg,loop-rotate,licm,"
+    "indvars,loop-idiom,loop-deletion,loop-unroll,loop-vectorize,slp-vectorizer,"
+    "instcombine,gvn,dse,adce,simplifycfg,globaldce";
+
+static const PassEntry *findPass(const string& name)
+{
+    for (const PassEntry& entry : PassTable) {
+        if (name == entry.name) return &entry;
+    }
+    return NULL;
+}
+
+/* Remarks and warnings of the passes, e.g. about the loops the hints of
+   NLoopStatement asked to vectorize, go to the debug log */
+static void logDiagnostic(const DiagnosticInfo& info, void *)
+{
+    string message;
+    raw_string_ostream stream(message);
+    DiagnosticPrinterRawOStream printer(stream);
+    info.print(printer);
+    LOG(info.getSeverity() == DS_Error ? LogLevel::Error : LogLevel::Debug, "LLVM: " + stream.str());
+}
+
+CodeGenOpt::Level CodeGenContext::codeGenOptLevel() const
+{
+    switch (options.optLevel) {
+        case 0: return CodeGenOpt::None;
+        case 1: return CodeGenOpt::Less;
+        case 2: return CodeGenOpt::Default;
+        default: return CodeGenOpt::Aggressive;
+    }
+}
+
+/* Runs the pass pipeline of the optimization level on the module */
+bool CodeGenContext::optimize(Module& target) const
+{
+    string pipeline = options.passes;
+    if (pipeline.empty()) {
+        switch (options.optLevel) {
+            case 0: return true;
+            case 1: pipeline = O1Pipeline; break;
+            case 2: pipeline = O2Pipeline; break;
+            default: pipeline = O3Pipeline; break;
+        }
+    }
+    LOG(LogLevel::Debug, "Optimizing with: " + pipeline);
+    TRACE_SCOPE("llvm", "optimize", target.getModuleIdentifier());
+    target.getContext().setDiagnosticHandler(logDiagnostic);
+
+    /* Give the passes the layout and cost model of the host target */
+    unique_ptr<TargetMachine> tm(EngineBuilder().setOptLevel(codeGenOptLevel()).selectTarget());
+    legacy::PassManager pm;
+    if (tm) {
+        target.setTargetTriple(tm->getTargetTriple().str());
+        target.setDataLayout(tm->createDataLayout());
+        pm.add(createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+    }
+
+    stringstream stream(pipeline);
+    string name;
+    while (getline(stream, name, ',')) {
+        if (name.empty()) continue;
+        const PassEntry *entry = findPass(name);
+        if (entry == NULL) {
+            LOG(LogLevel::Error, "Unknown pass: " + name);
+            return false;
+        }
+        pm.add(entry->create(options.optLevel));
+    }
+
+    pm.run(target);
+    if (Statistics::enabled())
+        Statistics::add(Counter::OptimizedIRInstructions, countInstructions(target));
+    LOG(LogLevel::Debug, "Module is optimized.");
+    return true;
+}
@@ -0,0 +1,71 @@
+#include "codegen.h"
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+/* Optimizes and compiles one partition in its own LLVMContext */
+static bool compilePartition(const CodeGenContext& context, const SmallVector<char, 0>& bitcode,
+                             bool forJIT, unique_ptr<MemoryBuffer>& object)
+{
+    LLVMContext llvmContext;
+    ErrorOr<unique_ptr<Module>> partition = parseBitcodeFile(
+        MemoryBufferRef(StringRef(bitcode.data(), bitcode.size()), "partition"), llvmContext);
+    if (!partition) {
+        LOG(LogLevel::Error, "Invalid partition: " + partition.getError().message());
+        return false;
+    }
+    if (!context.optimize(**partition))
+        return false;
+
+    SmallVector<char, 0> buffer;
+    raw_svector_ostream out(buffer);
+    if (!compileToObject(**partition, out, context.codeGenOptLevel(), forJIT))
+        return false;
+    object = MemoryBuffer::getMemBufferCopy(StringRef(buffer.data(), buffer.size()), "partition.o");
+    return true;
+}
+
+/* Splits the module into per-function partitions, each of them is moved
+   into its own LLVMContext and optimized and compiled on a pool of threads */
+bool CodeGenContext::compileParallel(unsigned jobs, bool forJIT, vector<unique_ptr<MemoryBuffer>>& objects)
+{
+    unsigned definitions = 0;
+    for (Function& function : *module) {
+        if (!function.isDeclaration()) definitions++;
+    }
+    LOG(LogLevel::Debug, "Compiling " + to_string(definitions) + " functions on " +
+        to_string(jobs) + " threads");
+
+    /* Partitions share the module's context, so they are serialized
+       here and parsed again by the worker that compiles them */
+    vector<SmallVector<char, 0>> partitions;
+    SplitModule(unique_ptr<Module>(module), definitions ? definitions : 1,
+        [&partitions](unique_ptr<Module> partition) {
+            partitions.emplace_back();
+            raw_svector_ostream out(partitions.back());
+            WriteBitcodeToFile(partition.get(), out);
+        });
+    module = NULL;
+
+    objects.clear();
+    objects.resize(partitions.size());
+    atomic<size_t> next(0);
+    atomic<bool> failed(false);
+    auto worker = [&]() {
+        for (size_t i = next++; i < partitions.size(); i = next++) {
+            if (!compilePartition(*this, partitions[i], forJIT, objects[i]))
+                failed = true;
+        }
+    };
+
+    vector<thread> threads;
+    for (unsigned i = 1; i < jobs; i++)
+        threads.push_back(thread(worker));
+    worker();
+    for (thread& t : threads)
+        t.join();
+    return !failed;
+}
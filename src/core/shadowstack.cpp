@@ -0,0 +1,272 @@
+#include "codegen.h"
+#include "../stats.h"
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/Transforms/Utils/PromoteMemToReg.h>
+#include <algorithm>
+
+using namespace std;
+
+/* Values of a function that point to objects, numbered in the order of
+   their definitions so the frame layout does not depend on addresses */
+struct ObjectValues {
+    vector<Value*> values;
+    DenseMap<Value*, unsigned> ids;
+
+    void add(Value *value) {
+        ids[value] = values.size();
+        values.push_back(value);
+    }
+    int find(Value *value) const {
+        DenseMap<Value*, unsigned>::const_iterator it = ids.find(value);
+        return it == ids.end() ? -1 : it->second;
+    }
+};
+
+/* Object pointers and boxes hold objects, pointers derived from them are
+   only used before the next call */
+static bool holdsObject(CodeGenContext& context, Type *type)
+{
+    return type == context.objectPointerType || type == context.stringPointerType ||
+        type == PointerType::getUnqual(context.integerType) || type == PointerType::getUnqual(context.doubleType);
+}
+
+/* Calls that can run the collector: everything but the runtime functions
+   that never allocate an object and LLVM intrinsics */
+static bool mayCollect(CodeGenContext& context, Instruction& instruction)
+{
+    CallInst *call = dyn_cast<CallInst>(&instruction);
+    if (call == NULL) return false;
+    Function *callee = call->getCalledFunction();
+    if (callee == NULL) return true;
+    if (callee->isIntrinsic()) return false;
+    Function *safe[] = {
+        context.getSlotFunction, context.putSlotFunction, context.getSlotCachedFunction,
+        context.putSlotCachedFunction, context.internSymbolFunction, context.checkBoxFunction,
+        context.divisionByZeroFunction, context.strlenFunction, context.strhashFunction,
+        context.strcmpFunction, context.gcAllocationBufferFunction, context.gcPushFrameFunction,
+        context.gcPopFrameFunction
+    };
+    return std::find(begin(safe), end(safe), callee) == end(safe);
+}
+
+/* Adds the operands of the instruction that hold objects to the set */
+static void addUses(const ObjectValues& objects, Instruction& instruction, BitVector& live)
+{
+    for (Value *operand : instruction.operands()) {
+        int id = objects.find(operand);
+        if (id >= 0) live.set(id);
+    }
+}
+
+/* Objects live at the end of every block. A phi uses its incoming values
+   at the end of their blocks. */
+static vector<BitVector> liveOut(const ObjectValues& objects, Function *function)
+{
+    DenseMap<BasicBlock*, unsigned> index;
+    vector<BasicBlock*> blocks;
+    for (BasicBlock& block : *function) {
+        index[&block] = blocks.size();
+        blocks.push_back(&block);
+    }
+    size_t count = objects.values.size();
+    vector<BitVector> exposed(blocks.size(), BitVector(count)), defined(blocks.size(), BitVector(count));
+    vector<BitVector> phiUses(blocks.size(), BitVector(count));
+    for (size_t i = 0; i < blocks.size(); i++) {
+        for (Instruction& instruction : *blocks[i]) {
+            if (PHINode *phi = dyn_cast<PHINode>(&instruction)) {
+                for (unsigned j = 0; j < phi->getNumIncomingValues(); j++) {
+                    int id = objects.find(phi->getIncomingValue(j));
+                    if (id >= 0) phiUses[index[phi->getIncomingBlock(j)]].set(id);
+                }
+            } else {
+                BitVector uses(count);
+                addUses(objects, instruction, uses);
+                exposed[i] |= uses.reset(defined[i]);
+            }
+            int id = objects.find(&instruction);
+            if (id >= 0) defined[i].set(id);
+        }
+    }
+
+    vector<BitVector> out(phiUses), in(blocks.size(), BitVector(count));
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t i = blocks.size(); i-- > 0; ) {
+            TerminatorInst *terminator = blocks[i]->getTerminator();
+            for (unsigned j = 0; terminator && j < terminator->getNumSuccessors(); j++)
+                out[i] |= in[index[terminator->getSuccessor(j)]];
+            BitVector live(out[i]);
+            live.reset(defined[i]);
+            live |= exposed[i];
+            if (live != in[i]) {
+                in[i] = live;
+                changed = true;
+            }
+        }
+    }
+    return out;
+}
+
+/* Records that the root interferes with the other roots in the set */
+static void interfere(vector<BitVector>& interference, const BitVector& roots, int id, BitVector others)
+{
+    others &= roots;
+    others.reset(id);
+    interference[id] |= others;
+    for (int other = others.find_first(); other >= 0; other = others.find_next(other))
+        interference[other].set(id);
+}
+
+/* Walks the block backwards with the objects live after each instruction.
+   Objects live across a call that can collect, or passed to it, are roots;
+   two roots interfere when one is defined while the other is live. */
+static void scanBlock(CodeGenContext& context, const ObjectValues& objects, BasicBlock& block,
+                      BitVector live, BitVector& roots, vector<BitVector> *interference)
+{
+    for (BasicBlock::reverse_iterator it = block.rbegin(); it != block.rend(); ++it) {
+        Instruction& instruction = *it;
+        if (isa<PHINode>(instruction)) break;
+        int id = objects.find(&instruction);
+        if (id >= 0) live.reset(id);
+        if (mayCollect(context, instruction)) {
+            roots |= live;
+            addUses(objects, instruction, roots);
+        }
+        if (id >= 0 && interference && roots.test(id))
+            interfere(*interference, roots, id, live);
+        addUses(objects, instruction, live);
+    }
+
+    /* Phis and, in the entry block, arguments are defined together */
+    BitVector defined(live.size());
+    for (Instruction& instruction : block) {
+        if (!isa<PHINode>(instruction)) break;
+        defined.set(objects.find(&instruction));
+    }
+    if (&block == &block.getParent()->getEntryBlock()) {
+        for (Argument& argument : block.getParent()->args()) {
+            int id = objects.find(&argument);
+            if (id >= 0) defined.set(id);
+        }
+    }
+    live |= defined;
+    if (interference) {
+        for (int id = defined.find_first(); id >= 0; id = defined.find_next(id)) {
+            if (roots.test(id))
+                interfere(*interference, roots, id, live);
+        }
+    }
+}
+
+/* Keeps the objects of the function visible to the collector in a frame
+   of the shadow stack (struct GCFrame of gc.h). The object locals are
+   promoted to SSA values first; a value gets a slot of the frame only if
+   it is live across a call that can collect, and is stored there where it
+   is defined. Values that are never live at the same time share a slot,
+   so the frame grows with the objects held at once, not with the number
+   of accesses in the function.
+   Objects never move, so nothing is reloaded from the frame. Object
+   locals that can not be promoted keep a slot of their own. The frame is
+   pushed on entry and popped before every return. */
+void CodeGenContext::emitShadowStack(Function *function)
+{
+    BasicBlock& entry = function->getEntryBlock();
+    vector<AllocaInst*> promoted, pinned;
+    for (BasicBlock& block : *function) {
+        for (Instruction& instruction : block) {
+            AllocaInst *alloca = dyn_cast<AllocaInst>(&instruction);
+            if (alloca == NULL || alloca->getAllocatedType() != objectPointerType) continue;
+            if (&block == &entry && isAllocaPromotable(alloca)) promoted.push_back(alloca);
+            else pinned.push_back(alloca);
+        }
+    }
+    /* Object locals read before they are assigned are null */
+    for (AllocaInst *alloca : promoted)
+        new StoreInst(ConstantPointerNull::get(objectPointerType), alloca, alloca->getNextNode());
+    if (!promoted.empty()) {
+        DominatorTree tree(*function);
+        PromoteMemToReg(promoted, tree);
+    }
+
+    ObjectValues objects;
+    for (Argument& argument : function->args()) {
+        if (holdsObject(*this, argument.getType())) objects.add(&argument);
+    }
+    for (BasicBlock& block : *function) {
+        for (Instruction& instruction : block) {
+            if (holdsObject(*this, instruction.getType())) objects.add(&instruction);
+        }
+    }
+
+    size_t count = objects.values.size();
+    vector<BitVector> out = liveOut(objects, function);
+    BitVector roots(count);
+    size_t index = 0;
+    for (BasicBlock& block : *function)
+        scanBlock(*this, objects, block, out[index++], roots, NULL);
+    vector<BitVector> interference(count, BitVector(count));
+    index = 0;
+    for (BasicBlock& block : *function)
+        scanBlock(*this, objects, block, out[index++], roots, &interference);
+
+    /* Greedy coloring in the order of definition */
+    vector<int> slotOf(count, -1);
+    size_t slotCount = 0;
+    for (int id = roots.find_first(); id >= 0; id = roots.find_next(id)) {
+        BitVector taken(slotCount + 1);
+        for (int other = interference[id].find_first(); other >= 0; other = interference[id].find_next(other)) {
+            if (slotOf[other] >= 0) taken.set(slotOf[other]);
+        }
+        size_t slot = 0;
+        while (taken.test(slot)) slot++;
+        slotOf[id] = slot;
+        slotCount = max(slotCount, slot + 1);
+    }
+    size_t frameSize = pinned.size() + slotCount;
+    if (Statistics::enabled())
+        Statistics::add(Counter::GCRootSlots, frameSize);
+    if (frameSize == 0) return;
+
+    LLVMContext& context = module->getContext();
+    vector<Type*> fields = { Type::getInt8PtrTy(context), Type::getInt64Ty(context),
+                             ArrayType::get(objectPointerType, frameSize) };
+    StructType *frameType = StructType::get(context, fields);
+    IRBuilder<> builder(&entry, entry.begin());
+    AllocaInst *frame = builder.CreateAlloca(frameType, NULL, "gcframe");
+    builder.CreateStore(builder.getInt64(frameSize), builder.CreateStructGEP(frameType, frame, 1));
+    vector<Value*> slots;
+    for (size_t i = 0; i < frameSize; i++) {
+        Value *indices[] = { builder.getInt32(0), builder.getInt32(2), builder.getInt32(i) };
+        Value *slot = builder.CreateInBoundsGEP(frameType, frame, indices,
+            i < pinned.size() ? pinned[i]->getName() : "root");
+        builder.CreateStore(ConstantPointerNull::get(objectPointerType), slot);
+        slots.push_back(slot);
+    }
+    for (size_t i = 0; i < pinned.size(); i++) {
+        pinned[i]->replaceAllUsesWith(slots[i]);
+        pinned[i]->eraseFromParent();
+    }
+    Value *framePointer = builder.CreateBitCast(frame, Type::getInt8PtrTy(context));
+    builder.CreateCall(gcPushFrameFunction, framePointer);
+
+    /* Arguments are stored after the push, other values where they are defined */
+    IRBuilder<> rootBuilder(context);
+    for (int id = roots.find_first(); id >= 0; id = roots.find_next(id)) {
+        Value *value = objects.values[id];
+        if (PHINode *phi = dyn_cast<PHINode>(value))
+            rootBuilder.SetInsertPoint(phi->getParent(), phi->getParent()->getFirstInsertionPt());
+        else if (Instruction *instruction = dyn_cast<Instruction>(value))
+            rootBuilder.SetInsertPoint(instruction->getNextNode());
+        else
+            rootBuilder.SetInsertPoint(builder.GetInsertBlock(), builder.GetInsertPoint());
+        rootBuilder.CreateStore(rootBuilder.CreatePointerCast(value, objectPointerType),
+            slots[pinned.size() + slotOf[id]]);
+    }
+
+    for (BasicBlock& block : *function) {
+        if (ReturnInst *ret = dyn_cast_or_null<ReturnInst>(block.getTerminator()))
+            CallInst::Create(gcPopFrameFunction, framePointer, "", ret);
+    }
+}
@@ -0,0 +1,796 @@
+#include <map>
+#include <set>
+#include <typeinfo>
+#include "simplify.h"
+#include "arena.h"
+#include "../grammar/parser.hpp"
+#include "../logger.h"
+#include "../trace.h"
+
+using namespace std;
+
+static bool isLiteral(NExpression *expr)
+{
+    return dynamic_cast<NInteger *>(expr) || dynamic_cast<NDouble *>(expr);
+}
+
+static NExpression *integer(long long value)
+{
+    NInteger *literal = new NInteger(value);
+    literal->type = VariableType::Integer;
+    return literal;
+}
+
+static NExpression *number(double value)
+{
+    NDouble *literal = new NDouble(value);
+    literal->type = VariableType::Double;
+    return literal;
+}
+
+/* Number known at compile time, a literal or the result of evaluating
+   a pure function */
+struct Constant {
+    bool isDouble;
+    long long integer;
+    double number;
+
+    double asDouble() const { return isDouble ? number : integer; }
+};
+
+static Constant integerConstant(long long value)
+{
+    return Constant { false, value, 0 };
+}
+
+static Constant doubleConstant(double value)
+{
+    return Constant { true, 0, value };
+}
+
+static Constant constantOf(NExpression *literal)
+{
+    if (NInteger *value = dynamic_cast<NInteger *>(literal)) return integerConstant(value->value);
+    return doubleConstant(static_cast<NDouble *>(literal)->value);
+}
+
+/* Block a şartlıgir on sayı runs for the value, NULL when none */
+static NBlock *takenCase(NSwitchStatement& statement, long long value)
+{
+    for (NSwitchCase *switchCase : statement.cases) {
+        for (NExpression *literal : switchCase->values) {
+            NInteger *integer = dynamic_cast<NInteger *>(literal);
+            if (integer && integer->value == value) return &switchCase->block;
+        }
+    }
+    return statement.defaultBlock;
+}
+
+static NExpression *literalOf(Constant value)
+{
+    return value.isDouble ? number(value.number) : integer(value.integer);
+}
+
+/* Converts the value to the static type of a variable, argument or
+   return value; integers are promoted to doubles */
+static Constant convertConstant(Constant value, VariableType type)
+{
+    return type == VariableType::Double && !value.isDouble ? doubleConstant(value.integer) : value;
+}
+
+/* Value of the literal as the type of the variable it initializes */
+static NExpression *literalOfType(NExpression *literal, VariableType type)
+{
+    return literalOf(convertConstant(constantOf(literal), type));
+}
+
+/* Operation on two numbers with the semantics of the generated code,
+   false when it can not be done at compile time */
+static bool evaluateOperator(int op, Constant lhs, Constant rhs, Constant& result)
+{
+    if (!lhs.isDouble && !rhs.isDouble) {
+        /* Integers wrap around like i64 instructions */
+        unsigned long long a = lhs.integer, b = rhs.integer;
+        switch (op) {
+            case TPLUS:  result = integerConstant((long long) (a + b)); return true;
+            case TMINUS: result = integerConstant((long long) (a - b)); return true;
+            case TMUL:   result = integerConstant((long long) (a * b)); return true;
+            case TDIV:
+                /* Division by zero is a runtime error, x / -1 is -x */
+                if (rhs.integer == 0) return false;
+                result = integerConstant(rhs.integer == -1 ? (long long) (0 - a) : lhs.integer / rhs.integer);
+                return true;
+            case TCEQ:   result = integerConstant(lhs.integer == rhs.integer); return true;
+            case TCNE:   result = integerConstant(lhs.integer != rhs.integer); return true;
+            case TCLT:   result = integerConstant(lhs.integer < rhs.integer); return true;
+            case TCLE:   result = integerConstant(lhs.integer <= rhs.integer); return true;
+            case TCGT:   result = integerConstant(lhs.integer > rhs.integer); return true;
+            case TCGE:   result = integerConstant(lhs.integer >= rhs.integer); return true;
+        }
+        return false;
+    }
+
+    double a = lhs.asDouble(), b = rhs.asDouble();
+    switch (op) {
+        case TPLUS:  result = doubleConstant(a + b); return true;
+        case TMINUS: result = doubleConstant(a - b); return true;
+        case TMUL:   result = doubleConstant(a * b); return true;
+        case TDIV:   result = doubleConstant(a / b); return true;
+        case TCEQ:   result = integerConstant(a == b); return true;
+        case TCNE:   result = integerConstant(a != b); return true;
+        case TCLT:   result = integerConstant(a < b); return true;
+        case TCLE:   result = integerConstant(a <= b); return true;
+        case TCGT:   result = integerConstant(a > b); return true;
+        case TCGE:   result = integerConstant(a >= b); return true;
+    }
+    return false;
+}
+
+/* Operation on two literals, NULL when it can not be folded */
+static NExpression *fold(int op, NExpression *lhs, NExpression *rhs)
+{
+    Constant result;
+    if (!evaluateOperator(op, constantOf(lhs), constantOf(rhs), result)) return NULL;
+    return literalOf(result);
+}
+
+/* Counts the uses of the names in a function: reads, assignments and
+   declarations. Nodes it does not know make the counts incomplete. */
+class UseCounter {
+public:
+    map<string, int> uses;
+    map<string, int> assignments;
+    map<string, int> declarations;
+    set<string> called;
+    bool complete = true;
+
+    void countExpression(NExpression& expr) {
+        if (dynamic_cast<NInteger *>(&expr) || dynamic_cast<NDouble *>(&expr) || dynamic_cast<NString *>(&expr))
+            return;
+        if (NIdentifier *ident = dynamic_cast<NIdentifier *>(&expr)) {
+            uses[ident->name.str()]++;
+        } else if (NReference *ref = dynamic_cast<NReference *>(&expr)) {
+            uses[ref->refs.front()->name.str()]++;
+        } else if (NMethodCall *call = dynamic_cast<NMethodCall *>(&expr)) {
+            called.insert(call->ref.refs.front()->name.str());
+            for (NExpression *argument : call->arguments)
+                countExpression(*argument);
+        } else if (NBinaryOperator *binary = dynamic_cast<NBinaryOperator *>(&expr)) {
+            countExpression(binary->lhs);
+            countExpression(binary->rhs);
+        } else if (NAssignment *assignment = dynamic_cast<NAssignment *>(&expr)) {
+            string name = assignment->lhs.refs.front()->name.str();
+            uses[name]++;
+            if (assignment->lhs.refs.size() == 1) assignments[name]++;
+            countExpression(assignment->rhs);
+        } else if (NBlock *block = dynamic_cast<NBlock *>(&expr)) {
+            countBlock(*block);
+        } else {
+            complete = false;
+        }
+    }
+
+    void countStatement(NStatement& stmt) {
+        if (NExpressionStatement *expr = dynamic_cast<NExpressionStatement *>(&stmt)) {
+            countExpression(expr->expression);
+        } else if (NReturnStatement *ret = dynamic_cast<NReturnStatement *>(&stmt)) {
+            countExpression(ret->expression);
+        } else if (NVariableDeclaration *decl = dynamic_cast<NVariableDeclaration *>(&stmt)) {
+            declarations[decl->id.name.str()]++;
+            if (decl->assignmentExpr) countExpression(*decl->assignmentExpr);
+        } else if (NFunctionDeclaration *decl = dynamic_cast<NFunctionDeclaration *>(&stmt)) {
+            /* Has locals of its own, only its calls matter here */
+            UseCounter body;
+            body.countBlock(decl->block);
+            called.insert(body.called.begin(), body.called.end());
+            complete = complete && body.complete;
+        } else if (NIfStatement *ifStatement = dynamic_cast<NIfStatement *>(&stmt)) {
+            countExpression(*ifStatement->condition);
+            countBlock(ifStatement->thenBlock);
+            if (ifStatement->elseBlock) countBlock(*ifStatement->elseBlock);
+        } else if (NLoopStatement *loop = dynamic_cast<NLoopStatement *>(&stmt)) {
+            if (loop->init) countStatement(*loop->init);
+            if (loop->condition) countExpression(*loop->condition);
+            if (loop->step) countExpression(*loop->step);
+            countBlock(loop->block);
+        } else if (NSwitchStatement *switchStatement = dynamic_cast<NSwitchStatement *>(&stmt)) {
+            countExpression(*switchStatement->value);
+            for (NSwitchCase *switchCase : switchStatement->cases)
+                countBlock(switchCase->block);
+            if (switchStatement->defaultBlock) countBlock(*switchStatement->defaultBlock);
+        } else if (!dynamic_cast<NExternDeclaration *>(&stmt) && !dynamic_cast<NBreakStatement *>(&stmt) &&
+                   !dynamic_cast<NContinueStatement *>(&stmt)) {
+            complete = false;
+        }
+    }
+
+    void countBlock(NBlock& block) {
+        for (NStatement *statement : block.statements)
+            countStatement(*statement);
+    }
+};
+
+static bool isNumeric(VariableType type)
+{
+    return type == VariableType::Integer || type == VariableType::Double;
+}
+
+typedef map<string, NFunctionDeclaration *> FunctionMap;
+
+/* Whether a function only computes its result from its numeric arguments:
+   no slots, strings, objects, externs or core functions like sayi_yaz, and
+   calls only to functions that may be pure as well */
+class PurityCheck {
+    set<string> names;
+
+public:
+    set<string> callees;
+
+    bool isPure(NExpression& expr) {
+        if (isLiteral(&expr)) return true;
+        if (NIdentifier *ident = dynamic_cast<NIdentifier *>(&expr))
+            return names.count(ident->name.str());
+        if (NReference *ref = dynamic_cast<NReference *>(&expr))
+            return ref->refs.size() == 1 && names.count(ref->refs.front()->name.str());
+        if (NBinaryOperator *binary = dynamic_cast<NBinaryOperator *>(&expr))
+            return isPure(binary->lhs) && isPure(binary->rhs);
+        if (NAssignment *assignment = dynamic_cast<NAssignment *>(&expr))
+            return assignment->lhs.refs.size() == 1 && names.count(assignment->lhs.refs.front()->name.str()) &&
+                   isPure(assignment->rhs);
+        if (NMethodCall *call = dynamic_cast<NMethodCall *>(&expr)) {
+            callees.insert(call->ref.refs.front()->name.str());
+            for (NExpression *argument : call->arguments) {
+                if (!isPure(*argument)) return false;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    bool isPure(NStatement& stmt) {
+        if (NExpressionStatement *expr = dynamic_cast<NExpressionStatement *>(&stmt))
+            return isPure(expr->expression);
+        if (NReturnStatement *ret = dynamic_cast<NReturnStatement *>(&stmt))
+            return isPure(ret->expression);
+        if (NVariableDeclaration *decl = dynamic_cast<NVariableDeclaration *>(&stmt)) {
+            if (!isNumeric(decl->type) && decl->type != VariableType::Any) return false;
+            if (decl->assignmentExpr && !isPure(*decl->assignmentExpr)) return false;
+            names.insert(decl->id.name.str());
+            return true;
+        }
+        if (NIfStatement *ifStatement = dynamic_cast<NIfStatement *>(&stmt))
+            return isPure(*ifStatement->condition) && isPureBlock(ifStatement->thenBlock) &&
+                   (ifStatement->elseBlock == NULL || isPureBlock(*ifStatement->elseBlock));
+        if (NLoopStatement *loop = dynamic_cast<NLoopStatement *>(&stmt))
+            return (loop->init == NULL || isPure(*loop->init)) && (loop->condition == NULL || isPure(*loop->condition)) &&
+                   (loop->step == NULL || isPure(*loop->step)) && isPureBlock(loop->block);
+        if (NSwitchStatement *switchStatement = dynamic_cast<NSwitchStatement *>(&stmt)) {
+            if (switchStatement->value->type != VariableType::Integer || !isPure(*switchStatement->value)) return false;
+            for (NSwitchCase *switchCase : switchStatement->cases) {
+                if (!isPureBlock(switchCase->block)) return false;
+            }
+            return switchStatement->defaultBlock == NULL || isPureBlock(*switchStatement->defaultBlock);
+        }
+        return dynamic_cast<NBreakStatement *>(&stmt) || dynamic_cast<NContinueStatement *>(&stmt);
+    }
+
+    bool isPureBlock(NBlock& block) {
+        for (NStatement *statement : block.statements) {
+            if (!isPure(*statement)) return false;
+        }
+        return true;
+    }
+
+    bool isPure(NFunctionDeclaration& function) {
+        if (!isNumeric(function.type) && function.type != VariableType::Any) return false;
+        for (NVariableDeclaration *argument : function.arguments) {
+            if (!isNumeric(argument->type) && argument->type != VariableType::Any) return false;
+            names.insert(argument->id.name.str());
+        }
+        return isPureBlock(function.block);
+    }
+};
+
+/* Top level functions that are pure, dropping the ones that call
+   functions which are not until nothing changes */
+static FunctionMap findPureFunctions(NBlock& program)
+{
+    FunctionMap pure;
+    map<string, set<string>> callees;
+    for (NStatement *statement : program.statements) {
+        NFunctionDeclaration *decl = dynamic_cast<NFunctionDeclaration *>(statement);
+        if (decl == NULL) continue;
+        PurityCheck check;
+        if (check.isPure(*decl)) {
+            pure[decl->id.name.str()] = decl;
+            callees[decl->id.name.str()] = check.callees;
+        }
+    }
+    for (bool changed = true; changed; ) {
+        changed = false;
+        FunctionMap::iterator it = pure.begin();
+        while (it != pure.end()) {
+            bool callsImpure = false;
+            for (const string& callee : callees[it->first])
+                callsImpure = callsImpure || pure.count(callee) == 0;
+            if (callsImpure) {
+                it = pure.erase(it);
+                changed = true;
+            } else {
+                it++;
+            }
+        }
+    }
+    return pure;
+}
+
+/* Runs a call of a pure function during compilation. Gives up when the
+   generated code would behave differently (division by zero, reading a
+   variable without a value), and when the call takes too many steps or
+   recurses too deep, the program computes it at run time then. */
+class Evaluator {
+    static const int MaxSteps = 10000;
+    static const int MaxDepth = 64;
+
+    const FunctionMap& functions;
+    int steps = 0, depth = 0;
+
+    struct Frame {
+        map<string, VariableType> types;
+        map<string, Constant> values;
+    };
+    Frame *frame = NULL;
+
+    bool read(const string& name, Constant& result) {
+        map<string, Constant>::iterator it = frame->values.find(name);
+        if (it == frame->values.end()) return false;
+        result = it->second;
+        return true;
+    }
+
+    bool evaluate(NExpression& expr, Constant& result) {
+        if (++steps > MaxSteps) return false;
+        if (isLiteral(&expr)) {
+            result = constantOf(&expr);
+            return true;
+        }
+        if (NIdentifier *ident = dynamic_cast<NIdentifier *>(&expr))
+            return read(ident->name.str(), result);
+        if (NReference *ref = dynamic_cast<NReference *>(&expr))
+            return read(ref->refs.front()->name.str(), result);
+        if (NBinaryOperator *binary = dynamic_cast<NBinaryOperator *>(&expr)) {
+            Constant lhs, rhs;
+            return evaluate(binary->lhs, lhs) && evaluate(binary->rhs, rhs) &&
+                   evaluateOperator(binary->op, lhs, rhs, result);
+        }
+        if (NAssignment *assignment = dynamic_cast<NAssignment *>(&expr)) {
+            string name = assignment->lhs.refs.front()->name.str();
+            if (!evaluate(assignment->rhs, result)) return false;
+            result = convertConstant(result, frame->types[name]);
+            frame->values[name] = result;
+            return true;
+        }
+        if (NMethodCall *call = dynamic_cast<NMethodCall *>(&expr)) {
+            vector<Constant> arguments(call->arguments.size());
+            for (size_t i = 0; i < arguments.size(); i++) {
+                if (!evaluate(*call->arguments[i], arguments[i])) return false;
+            }
+            FunctionMap::const_iterator it = functions.find(call->ref.refs.front()->name.str());
+            return it != functions.end() && run(*it->second, arguments, result);
+        }
+        return false;
+    }
+
+    /* How the execution of a statement ends */
+    enum class Flow { Next, Return, Break, Continue, GiveUp };
+
+    Flow execute(NStatement& stmt, VariableType returnType, Constant& result) {
+        if (++steps > MaxSteps) return Flow::GiveUp;
+        if (NExpressionStatement *expr = dynamic_cast<NExpressionStatement *>(&stmt))
+            return evaluate(expr->expression, result) ? Flow::Next : Flow::GiveUp;
+        if (NReturnStatement *ret = dynamic_cast<NReturnStatement *>(&stmt)) {
+            if (!evaluate(ret->expression, result)) return Flow::GiveUp;
+            result = convertConstant(result, returnType);
+            return Flow::Return;
+        }
+        if (NVariableDeclaration *decl = dynamic_cast<NVariableDeclaration *>(&stmt)) {
+            string name = decl->id.name.str();
+            frame->values.erase(name);
+            frame->types[name] = decl->type;
+            if (decl->assignmentExpr == NULL) return Flow::Next;
+            Constant value;
+            if (!evaluate(*decl->assignmentExpr, value)) return Flow::GiveUp;
+            /* herhangi variables take the type of their initial value */
+            if (decl->type == VariableType::Any)
+                frame->types[name] = value.isDouble ? VariableType::Double : VariableType::Integer;
+            frame->values[name] = convertConstant(value, frame->types[name]);
+            return Flow::Next;
+        }
+        if (NIfStatement *ifStatement = dynamic_cast<NIfStatement *>(&stmt)) {
+            Constant condition;
+            if (!evaluate(*ifStatement->condition, condition)) return Flow::GiveUp;
+            if (condition.asDouble() != 0) return execute(ifStatement->thenBlock, returnType, result);
+            return ifStatement->elseBlock ? execute(*ifStatement->elseBlock, returnType, result) : Flow::Next;
+        }
+        if (NLoopStatement *loop = dynamic_cast<NLoopStatement *>(&stmt)) {
+            Flow flow = loop->init ? execute(*loop->init, returnType, result) : Flow::Next;
+            for (Constant value; flow == Flow::Next || flow == Flow::Continue; ) {
+                if (loop->condition) {
+                    if (!evaluate(*loop->condition, value)) return Flow::GiveUp;
+                    if (value.asDouble() == 0) return Flow::Next;
+                }
+                flow = execute(loop->block, returnType, result);
+                if (flow == Flow::Break) return Flow::Next;
+                if ((flow == Flow::Next || flow == Flow::Continue) && loop->step && !evaluate(*loop->step, value))
+                    return Flow::GiveUp;
+                if (++steps > MaxSteps) return Flow::GiveUp;
+            }
+            return flow;
+        }
+        if (NSwitchStatement *switchStatement = dynamic_cast<NSwitchStatement *>(&stmt)) {
+            Constant value;
+            if (!evaluate(*switchStatement->value, value) || value.isDouble) return Flow::GiveUp;
+            NBlock *taken = takenCase(*switchStatement, value.integer);
+            return taken ? execute(*taken, returnType, result) : Flow::Next;
+        }
+        if (dynamic_cast<NBreakStatement *>(&stmt)) return Flow::Break;
+        if (dynamic_cast<NContinueStatement *>(&stmt)) return Flow::Continue;
+        return Flow::GiveUp;
+    }
+
+    /* Executes the statements up to a döndür, çık or atla */
+    Flow execute(NBlock& block, VariableType returnType, Constant& result) {
+        for (NStatement *statement : block.statements) {
+            Flow flow = execute(*statement, returnType, result);
+            if (flow != Flow::Next) return flow;
+        }
+        return Flow::Next;
+    }
+
+public:
+    Evaluator(const FunctionMap& functions) : functions(functions) { }
+
+    bool run(NFunctionDeclaration& function, const vector<Constant>& arguments, Constant& result) {
+        if (function.arguments.size() != arguments.size() || depth >= MaxDepth) return false;
+        Frame callee;
+        vector<VariableType> types;
+        for (size_t i = 0; i < arguments.size(); i++) {
+            VariableType type = function.arguments[i]->type;
+            if (type == VariableType::Any)
+                type = arguments[i].isDouble ? VariableType::Double : VariableType::Integer;
+            types.push_back(type);
+            callee.types[function.arguments[i]->id.name.str()] = type;
+            callee.values[function.arguments[i]->id.name.str()] = convertConstant(arguments[i], type);
+        }
+        VariableType returnType = function.type;
+        if (function.isGeneric()) {
+            map<vector<VariableType>, VariableType>::iterator it = function.specializations.find(types);
+            if (it == function.specializations.end()) return false;
+            returnType = it->second;
+        }
+        if (!isNumeric(returnType)) return false;
+
+        Frame *caller = frame;
+        frame = &callee;
+        depth++;
+        /* Falling off the end returns zero, which is left to run time */
+        bool done = execute(function.block, returnType, result) == Flow::Return;
+        depth--;
+        frame = caller;
+        return done;
+    }
+};
+
+class Simplifier {
+    /* State of the function being simplified */
+    UseCounter counts;
+    set<string> arguments;
+    map<string, NExpression *> constants;
+
+public:
+    FunctionMap pureFunctions;
+    uint64_t folded = 0, propagated = 0, unreachable = 0, unused = 0, evaluated = 0;
+
+    NExpression *simplify(NExpression *expr) {
+        if (NReference *ref = dynamic_cast<NReference *>(expr)) {
+            if (ref->refs.size() != 1) return expr;
+            map<string, NExpression *>::iterator it = constants.find(ref->refs.front()->name.str());
+            if (it == constants.end()) return expr;
+            propagated++;
+            return literalOfType(it->second, it->second->type);
+        }
+        if (NMethodCall *call = dynamic_cast<NMethodCall *>(expr)) {
+            bool constant = true;
+            for (NExpression *&argument : call->arguments) {
+                argument = simplify(argument);
+                constant = constant && isLiteral(argument);
+            }
+            string name = call->ref.refs.front()->name.str();
+            FunctionMap::iterator it = pureFunctions.find(name);
+            if (!constant || it == pureFunctions.end()) return expr;
+            vector<Constant> arguments;
+            for (NExpression *argument : call->arguments)
+                arguments.push_back(constantOf(argument));
+            Constant result;
+            if (!Evaluator(pureFunctions).run(*it->second, arguments, result)) {
+                LOG(LogLevel::Debug, "Not evaluating a call of " + name + " during compilation");
+                return expr;
+            }
+            evaluated++;
+            return literalOf(result);
+        }
+        if (NBinaryOperator *binary = dynamic_cast<NBinaryOperator *>(expr)) {
+            NExpression *lhs = simplify(&binary->lhs), *rhs = simplify(&binary->rhs);
+            if (isLiteral(lhs) && isLiteral(rhs)) {
+                if (NExpression *result = fold(binary->op, lhs, rhs)) {
+                    folded++;
+                    return result;
+                }
+            }
+            if (lhs == &binary->lhs && rhs == &binary->rhs) return expr;
+            NBinaryOperator *result = new NBinaryOperator(*lhs, binary->op, *rhs);
+            result->type = binary->type;
+            return result;
+        }
+        if (NAssignment *assignment = dynamic_cast<NAssignment *>(expr)) {
+            NExpression *rhs = simplify(&assignment->rhs);
+            if (rhs == &assignment->rhs) return expr;
+            NAssignment *result = new NAssignment(assignment->lhs, *rhs);
+            result->type = assignment->type;
+            return result;
+        }
+        if (NBlock *block = dynamic_cast<NBlock *>(expr)) {
+            simplifyBlock(*block);
+            return expr;
+        }
+        return expr;
+    }
+
+    /* Whether the expression can be dropped without changing what the
+       program does */
+    static bool isPure(NExpression& expr) {
+        if (NBinaryOperator *binary = dynamic_cast<NBinaryOperator *>(&expr))
+            return isPure(binary->lhs) && isPure(binary->rhs);
+        return isLiteral(&expr) || dynamic_cast<NString *>(&expr) || dynamic_cast<NReference *>(&expr);
+    }
+
+    NStatement *simplifyStatement(NStatement *stmt) {
+        if (NExpressionStatement *expr = dynamic_cast<NExpressionStatement *>(stmt)) {
+            NExpression *result = simplify(&expr->expression);
+            return result == &expr->expression ? stmt : new NExpressionStatement(*result);
+        }
+        if (NReturnStatement *ret = dynamic_cast<NReturnStatement *>(stmt)) {
+            NExpression *result = simplify(&ret->expression);
+            return result == &ret->expression ? stmt : new NReturnStatement(*result);
+        }
+        if (NVariableDeclaration *decl = dynamic_cast<NVariableDeclaration *>(stmt)) {
+            if (decl->assignmentExpr == NULL) return stmt;
+            decl->assignmentExpr = simplify(decl->assignmentExpr);
+            string name = decl->id.name.str();
+            bool numeric = decl->type == VariableType::Integer || decl->type == VariableType::Double ||
+                           decl->type == VariableType::Any;
+            if (numeric && isLiteral(decl->assignmentExpr) && counts.complete && counts.declarations[name] == 1 &&
+                counts.assignments[name] == 0 && arguments.count(name) == 0) {
+                NExpression *literal = decl->assignmentExpr;
+                constants[name] = decl->type == VariableType::Any ? literal : literalOfType(literal, decl->type);
+            }
+            return stmt;
+        }
+        if (NFunctionDeclaration *decl = dynamic_cast<NFunctionDeclaration *>(stmt)) {
+            simplifyFunction(*decl);
+            return stmt;
+        }
+        if (NIfStatement *ifStatement = dynamic_cast<NIfStatement *>(stmt)) {
+            ifStatement->condition = simplify(ifStatement->condition);
+            simplifyBlock(ifStatement->thenBlock);
+            if (ifStatement->elseBlock) simplifyBlock(*ifStatement->elseBlock);
+            if (!isLiteral(ifStatement->condition)) return stmt;
+            /* Only the branch the condition takes is kept, unless the
+               other one declares variables the code after it may use */
+            bool taken = constantOf(ifStatement->condition).asDouble() != 0;
+            NBlock *kept = taken ? &ifStatement->thenBlock : ifStatement->elseBlock;
+            NBlock *dropped = taken ? ifStatement->elseBlock : &ifStatement->thenBlock;
+            if (dropped && declaresVariables(*dropped)) return stmt;
+            if (dropped) unreachable += dropped->statements.size();
+            return new NExpressionStatement(kept ? *kept : *new NBlock());
+        }
+        if (NLoopStatement *loop = dynamic_cast<NLoopStatement *>(stmt)) {
+            if (loop->init) loop->init = simplifyStatement(loop->init);
+            if (loop->condition) loop->condition = simplify(loop->condition);
+            if (loop->step) loop->step = simplify(loop->step);
+            simplifyBlock(loop->block);
+            return stmt;
+        }
+        if (NSwitchStatement *switchStatement = dynamic_cast<NSwitchStatement *>(stmt))
+            return simplifySwitch(*switchStatement);
+        return stmt;
+    }
+
+    /* A şartlıgir on a literal is replaced by the block it runs, like an
+       eğer, unless the other blocks declare variables */
+    NStatement *simplifySwitch(NSwitchStatement& statement) {
+        statement.value = simplify(statement.value);
+        for (NSwitchCase *switchCase : statement.cases)
+            simplifyBlock(switchCase->block);
+        if (statement.defaultBlock) simplifyBlock(*statement.defaultBlock);
+        NInteger *value = dynamic_cast<NInteger *>(statement.value);
+        if (value == NULL) return &statement;
+
+        NBlock *kept = takenCase(statement, value->value);
+        size_t dropped = 0;
+        vector<NBlock *> blocks;
+        for (NSwitchCase *switchCase : statement.cases)
+            blocks.push_back(&switchCase->block);
+        if (statement.defaultBlock) blocks.push_back(statement.defaultBlock);
+        for (NBlock *block : blocks) {
+            if (block == kept) continue;
+            if (declaresVariables(*block)) return &statement;
+            dropped += block->statements.size();
+        }
+        unreachable += dropped;
+        return new NExpressionStatement(kept ? *kept : *new NBlock());
+    }
+
+    static bool declaresVariables(NBlock& block) {
+        for (NStatement *statement : block.statements) {
+            if (dynamic_cast<NVariableDeclaration *>(statement)) return true;
+            NIfStatement *ifStatement = dynamic_cast<NIfStatement *>(statement);
+            if (ifStatement && (declaresVariables(ifStatement->thenBlock) ||
+                                (ifStatement->elseBlock && declaresVariables(*ifStatement->elseBlock))))
+                return true;
+            NLoopStatement *loop = dynamic_cast<NLoopStatement *>(statement);
+            if (loop && (dynamic_cast<NVariableDeclaration *>(loop->init) || declaresVariables(loop->block)))
+                return true;
+            if (NSwitchStatement *switchStatement = dynamic_cast<NSwitchStatement *>(statement)) {
+                for (NSwitchCase *switchCase : switchStatement->cases) {
+                    if (declaresVariables(switchCase->block)) return true;
+                }
+                if (switchStatement->defaultBlock && declaresVariables(*switchStatement->defaultBlock)) return true;
+            }
+            NExpressionStatement *expr = dynamic_cast<NExpressionStatement *>(statement);
+            NBlock *inner = expr ? dynamic_cast<NBlock *>(&expr->expression) : NULL;
+            if (inner && declaresVariables(*inner)) return true;
+        }
+        return false;
+    }
+
+    /* The statements after a döndür, çık or atla never run. Declarations
+       are kept, variables are visible in the rest of the function. */
+    void simplifyBlock(NBlock& block) {
+        bool returned = false;
+        StatementList::iterator it = block.statements.begin();
+        while (it != block.statements.end()) {
+            bool declaration = dynamic_cast<NFunctionDeclaration *>(*it) || dynamic_cast<NExternDeclaration *>(*it) ||
+                               dynamic_cast<NVariableDeclaration *>(*it);
+            if (returned && !declaration) {
+                unreachable++;
+                it = block.statements.erase(it);
+                continue;
+            }
+            *it = simplifyStatement(*it);
+            if (dynamic_cast<NReturnStatement *>(*it) || dynamic_cast<NBreakStatement *>(*it) ||
+                dynamic_cast<NContinueStatement *>(*it))
+                returned = true;
+            it++;
+        }
+    }
+
+    /* Drops the declarations of variables nothing refers to, keeping
+       initial values that do something */
+    void removeUnused(NBlock& block, UseCounter& uses) {
+        StatementList::iterator it = block.statements.begin();
+        while (it != block.statements.end()) {
+            NVariableDeclaration *decl = dynamic_cast<NVariableDeclaration *>(*it);
+            if (NExpressionStatement *expr = dynamic_cast<NExpressionStatement *>(*it)) {
+                if (NBlock *inner = dynamic_cast<NBlock *>(&expr->expression))
+                    removeUnused(*inner, uses);
+            } else if (NIfStatement *ifStatement = dynamic_cast<NIfStatement *>(*it)) {
+                removeUnused(ifStatement->thenBlock, uses);
+                if (ifStatement->elseBlock) removeUnused(*ifStatement->elseBlock, uses);
+            } else if (NLoopStatement *loop = dynamic_cast<NLoopStatement *>(*it)) {
+                removeUnused(loop->block, uses);
+            } else if (NSwitchStatement *switchStatement = dynamic_cast<NSwitchStatement *>(*it)) {
+                for (NSwitchCase *switchCase : switchStatement->cases)
+                    removeUnused(switchCase->block, uses);
+                if (switchStatement->defaultBlock) removeUnused(*switchStatement->defaultBlock, uses);
+            }
+            if (decl == NULL || uses.uses[decl->id.name.str()] > 0 || arguments.count(decl->id.name.str())) {
+                it++;
+                continue;
+            }
+            unused++;
+            if (decl->assignmentExpr && !isPure(*decl->assignmentExpr)) {
+                *it++ = new NExpressionStatement(*decl->assignmentExpr);
+            } else {
+                it = block.statements.erase(it);
+            }
+        }
+    }
+
+    void simplifyBody(NBlock& body) {
+        counts = UseCounter();
+        counts.countBlock(body);
+        simplifyBlock(body);
+
+        UseCounter uses;
+        uses.countBlock(body);
+        if (uses.complete) removeUnused(body, uses);
+    }
+
+    void simplifyFunction(NFunctionDeclaration& function) {
+        UseCounter outerCounts = counts;
+        set<string> outerArguments;
+        map<string, NExpression *> outerConstants;
+        outerArguments.swap(arguments);
+        outerConstants.swap(constants);
+
+        for (NVariableDeclaration *argument : function.arguments)
+            arguments.insert(argument->id.name.str());
+        simplifyBody(function.block);
+
+        counts = outerCounts;
+        arguments.swap(outerArguments);
+        constants.swap(outerConstants);
+    }
+
+    /* Top level functions no call reaches are not compiled */
+    void removeUncalled(NBlock& program) {
+        UseCounter calls;
+        for (NStatement *statement : program.statements) {
+            if (!dynamic_cast<NFunctionDeclaration *>(statement))
+                calls.countStatement(*statement);
+        }
+        if (!calls.complete) return;
+
+        map<string, NFunctionDeclaration *> functions;
+        for (NStatement *statement : program.statements) {
+            if (NFunctionDeclaration *decl = dynamic_cast<NFunctionDeclaration *>(statement))
+                functions[decl->id.name.str()] = decl;
+        }
+        set<string> reached;
+        vector<string> pending(calls.called.begin(), calls.called.end());
+        while (!pending.empty()) {
+            string name = pending.back();
+            pending.pop_back();
+            map<string, NFunctionDeclaration *>::iterator it = functions.find(name);
+            if (it == functions.end() || !reached.insert(name).second) continue;
+            UseCounter body;
+            body.countBlock(it->second->block);
+            if (!body.complete) return;
+            pending.insert(pending.end(), body.called.begin(), body.called.end());
+        }
+
+        StatementList::iterator it = program.statements.begin();
+        while (it != program.statements.end()) {
+            NFunctionDeclaration *decl = dynamic_cast<NFunctionDeclaration *>(*it);
+            if (decl && reached.count(decl->id.name.str()) == 0) {
+                LOG(LogLevel::Debug, "Removing uncalled function " + decl->id.name.str());
+                unused++;
+                it = program.statements.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+};
+
+void simplifyProgram(NBlock& program, Arena& arena)
+{
+    TRACE_SCOPE("codegen", "simplify");
+    Arena::Scope scope(arena);
+    Simplifier simplifier;
+    simplifier.pureFunctions = findPureFunctions(program);
+    simplifier.simplifyBody(program);
+    simplifier.removeUncalled(program);
+
+    LOG(LogLevel::Debug, "Simplified the AST: " + to_string(simplifier.folded) + " folded, " +
+        to_string(simplifier.propagated) + " propagated, " + to_string(simplifier.evaluated) + " evaluated calls, " +
+        to_string(simplifier.unreachable) + " unreachable statements, " + to_string(simplifier.unused) + " unused declarations");
+    if (Statistics::enabled()) {
+        Statistics::add(Counter::FoldedConstants, simplifier.folded);
+        Statistics::add(Counter::PropagatedConstants, simplifier.propagated);
+        Statistics::add(Counter::EvaluatedCalls, simplifier.evaluated);
+        Statistics::add(Counter::UnreachableStatements, simplifier.unreachable);
+        Statistics::add(Counter::UnusedDeclarations, simplifier.unused);
+    }
+}
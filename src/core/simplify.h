@@ -0,0 +1,17 @@
+#ifndef simplify_h
+#define simplify_h
+
+#include "node.h"
+
+class Arena;
+
+/* Simplifies the type checked AST before code generation: folds
+   arithmetic on literals, replaces variables that are only ever set by
+   their declaration with its literal, evaluates calls of pure functions
+   with literal arguments, removes the statements after a döndür and the
+   variables and functions nothing uses. New nodes are allocated in the
+   arena of the program. The eliminated nodes are counted in the
+   statistics and logged. */
+void simplifyProgram(NBlock& program, Arena& arena);
+
+#endif // simplify_h
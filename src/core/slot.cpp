@@ -1,43 +1,295 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "types.h"
+#include "gc.h"
+
+RuntimeCounters runtimeCounters;
+
+#define COUNT_CALL(counter) \
+	if (runtimeCounters.enabled.load(std::memory_order_relaxed)) \
+		runtimeCounters.counter.fetch_add(1, std::memory_order_relaxed)
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern mObject *objalloc();
+/* Symbol table of the process. Compiled code interns its slot names once
+   when it is loaded, so lookups compare IDs instead of strings. */
+static std::mutex symbolMutex;
+static std::unordered_map<std::string, SymbolID> symbolIDs;
+static std::vector<const char *> symbolNames(1, "");
+
+SymbolID internSymbol(const char *name)
+{
+	std::lock_guard<std::mutex> lock(symbolMutex);
+	std::unordered_map<std::string, SymbolID>::iterator it = symbolIDs.find(name);
+	if (it != symbolIDs.end())
+		return it->second;
+	SymbolID symbol = symbolNames.size();
+	symbolNames.push_back(strdup(name));
+	symbolIDs[name] = symbol;
+	return symbol;
+}
+
+const char *symbolName(SymbolID symbol)
+{
+	std::lock_guard<std::mutex> lock(symbolMutex);
+	return symbol < symbolNames.size() ? symbolNames[symbol] : NULL;
+}
+
+/* Objects with more slots than this are kept in dictionary mode, so the
+   shape tree stays small for objects used as maps */
+static const uint32_t MaxShapeSlots = 64;
+
+Shape emptyShape;
+Shape integerShape;
+Shape doubleShape;
+Shape stringShape;
+static std::mutex shapeMutex;
+
+/* Returns the shape reached by adding the slot, shared by every object
+   that adds the same slots in the same order */
+static Shape *addTransition(Shape *shape, SymbolID slot)
+{
+	Shape *last = shape->lastTransition.load(std::memory_order_acquire);
+	if (last && last->symbol == slot)
+		return last;
+
+	std::lock_guard<std::mutex> lock(shapeMutex);
+	Shape *&next = shape->transitions[slot];
+	if (next == NULL) {
+		next = new Shape();
+		next->parent = shape;
+		next->symbol = slot;
+		next->slotCount = shape->slotCount + 1;
+		next->indices = shape->indices;
+		next->indices[slot] = shape->slotCount;
+	}
+	shape->lastTransition.store(next, std::memory_order_release);
+	return next;
+}
+
+/* Size of the overflow array for the number of slots */
+static uint32_t overflowCapacity(uint32_t slotCount)
+{
+	if (slotCount <= InlineSlotCount) return 0;
+	uint32_t capacity = 4;
+	while (capacity < slotCount - InlineSlotCount) capacity *= 2;
+	return capacity;
+}
+
+static void makeDictionary(mObject *obj)
+{
+	slotmap *dictionary = new slotmap();
+	for (auto& entry : obj->shape->indices)
+		(*dictionary)[entry.first] = *slotAddress(obj, entry.second);
+	delete[] obj->overflow;
+	obj->shape = NULL;
+	obj->dictionary = dictionary;
+}
 
-mObject* getSlot(mObject *self, char *slot, int followChain)
+mObject* getSlot(mObject *self, SymbolID slot, int followChain)
 {
-	printf ("Getting slot for %s\n", slot);
+	COUNT_CALL(getSlot);
 	mObject *obj = self;
 	while (obj) {
-		//printf("obj %d\n", obj);
-		slotmap::iterator it = obj->slots->find(slot);
-		if (it == obj->slots->end()) {
-			if (followChain) { obj = obj->prototype; continue; }
-			else return NULL;
+		if (obj->shape) {
+			int index = shapeIndex(obj->shape, slot);
+			if (index >= 0) return *slotAddress(obj, index);
+		} else {
+			slotmap::iterator it = obj->dictionary->find(slot);
+			if (it != obj->dictionary->end()) return it->second;
 		}
-		//printf("Found slot %d\n", (*it).second);
-		return (*it).second;
+		if (!followChain) return NULL;
+		obj = obj->prototype;
 	}
 	return NULL;
 }
 
-void putSlot(mObject *self, char *slot, mObject *value)
+void putSlot(mObject *self, SymbolID slot, mObject *value)
+{
+	COUNT_CALL(putSlot);
+	if (self->shape) {
+		int index = shapeIndex(self->shape, slot);
+		if (index >= 0) {
+			*slotAddress(self, index) = value;
+			return;
+		}
+		if (self->shape->slotCount < MaxShapeSlots) {
+			Shape *next = addTransition(self->shape, slot);
+			uint32_t capacity = overflowCapacity(self->shape->slotCount);
+			if (overflowCapacity(next->slotCount) != capacity) {
+				mObject **overflow = new mObject*[overflowCapacity(next->slotCount)];
+				std::copy(self->overflow, self->overflow + capacity, overflow);
+				delete[] self->overflow;
+				self->overflow = overflow;
+			}
+			self->shape = next;
+			*slotAddress(self, next->slotCount - 1) = value;
+			return;
+		}
+		makeDictionary(self);
+	}
+	(*self->dictionary)[slot] = value;
+}
+
+static thread_local InlineCache *registeredCaches = NULL;
+
+/* Returns the index of the slot for a cache miss, remembering the shape
+   in a free entry of the cache */
+static int missInlineCache(InlineCache *cache, mObject *self, SymbolID slot)
 {
-	//printf ("Putting slot for %s\n", slot);
-	(*self->slots)[slot] = value;
+	cache->misses++;
+	if (!(cache->flags & InlineCacheRegistered) && runtimeCounters.enabled.load(std::memory_order_relaxed)) {
+		cache->flags |= InlineCacheRegistered;
+		cache->next = registeredCaches;
+		registeredCaches = cache;
+	}
+	if (self == NULL || self->shape == NULL)
+		return -1;
+
+	int index = shapeIndex(self->shape, slot);
+	if (index < 0 || (cache->flags & InlineCacheMegamorphic))
+		return index;
+	if (cache->count == InlineCacheEntries) {
+		cache->flags |= InlineCacheMegamorphic;
+		return index;
+	}
+	cache->entries[cache->count].shape = self->shape;
+	cache->entries[cache->count].index = index;
+	cache->count++;
+	return index;
+}
+
+/* Slow paths of the inline caches. The generated code checks every entry
+   of the cache before calling them, so the shape of the object is not in
+   the cache. Only own slots of the object are cached. */
+mObject *getSlotCached(mObject *self, SymbolID slot, InlineCache *cache)
+{
+	int index = missInlineCache(cache, self, slot);
+	if (index >= 0) return *slotAddress(self, index);
+	return getSlot(self, slot, 1);
+}
+
+void putSlotCached(mObject *self, SymbolID slot, mObject *value, InlineCache *cache)
+{
+	int index = missInlineCache(cache, self, slot);
+	if (index >= 0) *slotAddress(self, index) = value;
+	else putSlot(self, slot, value);
+}
+
+/* Cells come zeroed from gcAllocate, only the shape needs setting */
+mObject *objalloc()
+{
+	mObject *obj = (mObject *) gcAllocate(sizeof(mObject));
+	obj->shape = &emptyShape;
+	return obj;
+}
+
+cstring *stralloc(char *ptr, size_t len)
+{
+	cstring *string = (cstring *) gcAllocate(sizeof(cstring));
+	string->object.shape = &stringShape;
+	string->ptr = ptr;
+	string->len = len;
+	return string;
+}
+
+uint64_t strhash(const char *str)
+{
+	if (str == NULL)
+		return StringHashNull;
+	uint64_t hash = 14695981039346656037ULL;
+	for (; *str; str++) {
+		hash ^= (unsigned char) *str;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+cinteger *intalloc(uint64_t value)
+{
+	cinteger *integer = (cinteger *) gcAllocate(sizeof(cinteger));
+	integer->object.shape = &integerShape;
+	integer->value = value;
+	return integer;
+}
+
+cdouble *dblalloc(double value)
+{
+	cdouble *number = (cdouble *) gcAllocate(sizeof(cdouble));
+	number->object.shape = &doubleShape;
+	number->value = value;
+	return number;
+}
+
+/* Slow path of unboxing in generated code, for boxes that gained slots
+   and for objects that are no box of the kind. Boxes keep the shape of
+   their kind as the root of their transitions. */
+void checkBox(mObject *object, Shape *kind)
+{
+	for (Shape *shape = object->shape; shape; shape = shape->parent)
+		if (shape == kind)
+			return;
+	fprintf(stderr, "Runtime error: object is not a %s\n",
+		kind == &integerShape ? "sayı" : kind == &doubleShape ? "ondalıklı" : "yazı");
+	exit(1);
+}
+
+/* What the program printed so far comes before the error */
+void divisionByZero()
+{
+	fflush(stdout);
+	fprintf(stderr, "Runtime error: division by zero\n");
+	exit(1);
 }
 
 mObject* newobj(mObject *prototype)
 {
-	mObject *obj = new mObject;
-	mObject *init = getSlot(prototype, (char *)"init", 1);
+	COUNT_CALL(newobj);
+	/* Only this call holds the prototype while the allocation collects */
+	GCFrame frame;
+	frame.count = 1;
+	frame.roots[0] = prototype;
+	gcPushFrame(&frame);
+	mObject *obj = objalloc();
+	gcPopFrame(&frame);
 	obj->prototype = prototype;
-	obj->slots = new slotmap();
 	return obj;
 }
 
 #ifdef __cplusplus
 }
 #endif
+
+static std::mutex reportMutex;
+static std::vector<InlineCacheReport> reports;
+
+void retireInlineCaches()
+{
+	if (registeredCaches == NULL) return;
+	std::lock_guard<std::mutex> lock(reportMutex);
+	for (InlineCache *cache = registeredCaches; cache; cache = cache->next) {
+		InlineCacheReport report = { cache->site, cache->hits, cache->misses, cache->count,
+		                             (cache->flags & InlineCacheMegamorphic) != 0 };
+		reports.push_back(report);
+	}
+	registeredCaches = NULL;
+}
+
+std::vector<InlineCacheReport> inlineCacheReports()
+{
+	std::lock_guard<std::mutex> lock(reportMutex);
+	return reports;
+}
+
+void clearInlineCacheReports()
+{
+	std::lock_guard<std::mutex> lock(reportMutex);
+	reports.clear();
+}
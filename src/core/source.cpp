@@ -0,0 +1,99 @@
+#include "source.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../logger.h"
+
+using namespace std;
+
+SourceBuffer::SourceBuffer() : buffer(NULL), length(0), mappedLength(0)
+{
+    allocate(0);
+}
+
+SourceBuffer::~SourceBuffer()
+{
+    release();
+}
+
+void SourceBuffer::release()
+{
+    if (mappedLength)
+        munmap(buffer, mappedLength);
+    else
+        free(buffer);
+    buffer = NULL;
+    length = mappedLength = 0;
+}
+
+/* Heap buffer for the text and the terminator */
+void SourceBuffer::allocate(size_t size)
+{
+    release();
+    buffer = (char *) malloc(size + 2);
+    if (buffer == NULL)
+        throw bad_alloc();
+    buffer[size] = buffer[size + 1] = '\0';
+    length = size;
+}
+
+bool SourceBuffer::mapFile(const string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG(LogLevel::Error, "Could not open " + path + ": " + strerror(errno));
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+        /* Pipes and devices can not be mapped, read them instead */
+        close(fd);
+        ifstream file(path, ios::binary);
+        return readStream(file);
+    }
+
+    /* Reserve zeroed pages for the text and the terminator, then map the
+       file over them. The mapping is private, so flex can write into it. */
+    size_t size = status.st_size;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t mapped = (size + 2 + pageSize - 1) / pageSize * pageSize;
+    void *base = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (base != MAP_FAILED && size > 0 &&
+        mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, mapped);
+        base = MAP_FAILED;
+    }
+    close(fd);
+    if (base == MAP_FAILED) {
+        LOG(LogLevel::Error, "Could not map " + path + ": " + strerror(errno));
+        return false;
+    }
+
+    release();
+    buffer = (char *) base;
+    length = size;
+    mappedLength = mapped;
+    return true;
+}
+
+bool SourceBuffer::readStream(istream& stream)
+{
+    string text((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+    if (stream.bad())
+        return false;
+    assign(text.data(), text.size());
+    return true;
+}
+
+void SourceBuffer::assign(const char *text, size_t size)
+{
+    allocate(size);
+    memcpy(buffer, text, size);
+}
@@ -0,0 +1,40 @@
+#ifndef source_h
+#define source_h
+
+#include <cstddef>
+#include <istream>
+#include <string>
+
+/* Source text of a program. Files are mapped into memory instead of being
+   read, and the text is always followed by the two NUL bytes flex needs
+   to scan a buffer in place, so the lexer makes no copy of it. Tokens
+   refer to the text directly and are valid as long as the buffer is. */
+class SourceBuffer {
+    char *buffer;
+    size_t length;
+    size_t mappedLength; // non zero when the buffer is mapped
+
+    void allocate(size_t size);
+
+public:
+    SourceBuffer();
+    ~SourceBuffer();
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    /* Maps the file privately, returns false when it can not be opened */
+    bool mapFile(const std::string& path);
+    bool readStream(std::istream& stream);
+    void assign(const char *text, size_t size);
+
+    void release();
+
+    const char *data() const { return buffer; }
+    size_t size() const { return length; }
+
+    /* Writable text and its size with the terminator, for yy_scan_buffer */
+    char *scanBuffer() { return buffer; }
+    size_t scanSize() const { return length + 2; }
+};
+
+#endif // source_h
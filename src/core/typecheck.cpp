@@ -0,0 +1,415 @@
+#include <map>
+#include <set>
+#include <typeinfo>
+#include "typecheck.h"
+#include "types.h"
+#include "../grammar/parser.hpp"
+#include "../logger.h"
+#include "../trace.h"
+
+using namespace std;
+
+const char *typeName(VariableType type)
+{
+    switch (type) {
+        case VariableType::Integer: return "sayı";
+        case VariableType::Double:  return "ondalıklı";
+        case VariableType::String:  return "yazı";
+        case VariableType::Object:  return "nesne";
+        case VariableType::Void:    return "yok";
+        case VariableType::Any:     return "herhangi";
+        default:                    return "?";
+    }
+}
+
+/* Whether a value of the type can be used where the other is expected */
+static bool convertible(VariableType from, VariableType to)
+{
+    if (from == to) return true;
+    if (from == VariableType::Void || to == VariableType::Void) return false;
+    if (from == VariableType::Integer && to == VariableType::Double) return true;
+    return from == VariableType::Object || to == VariableType::Object;
+}
+
+struct Signature {
+    VariableType returnType;
+    vector<VariableType> parameters;
+};
+
+class TypeChecker {
+    map<string, Signature> functions;
+    map<string, NFunctionDeclaration *> generics;
+    /* Specializations being checked, calls to them are recursive */
+    set<pair<NFunctionDeclaration *, vector<VariableType>>> checking;
+    /* Locals of the function being checked and its return type. Types of
+       the return statements are collected when it is herhangi. */
+    map<string, VariableType> locals;
+    VariableType returnType;
+    vector<VariableType> returnTypes;
+    /* Name of the function in the errors, with the types of generic ones */
+    string function;
+    bool topLevel;
+    /* Loops around the statement being checked, çık and atla need one */
+    int loops;
+    bool failed;
+
+    bool fail(const string& reason) {
+        LOG(LogLevel::Error, "Type error in " + function + ": " + reason);
+        failed = true;
+        return false;
+    }
+
+    void expect(NExpression& expr, VariableType type, const string& context) {
+        if (!convertible(expr.type, type))
+            fail(context + " expects " + typeName(type) + ", got " + typeName(expr.type));
+    }
+
+    void declare(const string& name, VariableType returnType, const VariableList& arguments) {
+        Signature signature = { returnType, vector<VariableType>() };
+        for (NVariableDeclaration *argument : arguments)
+            signature.parameters.push_back(argument->type);
+        functions[name] = signature;
+    }
+
+    void declare(NFunctionDeclaration& function) {
+        if (function.isGeneric()) generics[function.id.name.str()] = &function;
+        else declare(function.id.name.str(), function.type, function.arguments);
+    }
+
+    VariableType identifier(const string& name) {
+        if (name == "null") return VariableType::Object;
+        map<string, VariableType>::iterator it = locals.find(name);
+        if (it != locals.end()) return it->second;
+        /* Unknown identifiers are new objects, see NIdentifier::codeGen */
+        locals[name] = VariableType::Object;
+        return VariableType::Object;
+    }
+
+    VariableType check(NExpression& expr) {
+        expr.type = infer(expr);
+        return expr.type;
+    }
+
+    /* Conditions are numbers, zero is false */
+    void checkCondition(NExpression& condition, const char *statement) {
+        VariableType type = check(condition);
+        if (type != VariableType::Integer && type != VariableType::Double)
+            fail(string("condition of ") + statement + " is " + typeName(type));
+    }
+
+    VariableType infer(NExpression& expr) {
+        if (dynamic_cast<NInteger *>(&expr)) return VariableType::Integer;
+        if (dynamic_cast<NDouble *>(&expr)) return VariableType::Double;
+        if (dynamic_cast<NString *>(&expr)) return VariableType::String;
+        if (NIdentifier *ident = dynamic_cast<NIdentifier *>(&expr))
+            return identifier(ident->name.str());
+        if (NReference *ref = dynamic_cast<NReference *>(&expr)) {
+            VariableType type = identifier(ref->refs.front()->name.str());
+            if (ref->refs.size() == 1) return type;
+            if (type != VariableType::Object)
+                fail("slot of " + ref->refs.front()->name.str() + ", a " + typeName(type));
+            return VariableType::Object;
+        }
+        if (NMethodCall *call = dynamic_cast<NMethodCall *>(&expr)) {
+            string name = call->ref.refs.front()->name.str();
+            for (NExpression *argument : call->arguments)
+                check(*argument);
+            map<string, NFunctionDeclaration *>::iterator generic = generics.find(name);
+            if (generic != generics.end())
+                return specialize(*generic->second, *call);
+            map<string, Signature>::iterator it = functions.find(name);
+            if (it == functions.end()) {
+                fail("no such function " + name);
+                return VariableType::Void;
+            }
+            if (it->second.parameters.size() != call->arguments.size()) {
+                fail(name + " takes " + to_string(it->second.parameters.size()) + " arguments, got " +
+                     to_string(call->arguments.size()));
+            } else {
+                for (size_t i = 0; i < call->arguments.size(); i++)
+                    expect(*call->arguments[i], it->second.parameters[i], "argument " + to_string(i + 1) + " of " + name);
+            }
+            return it->second.returnType;
+        }
+        if (NBinaryOperator *binary = dynamic_cast<NBinaryOperator *>(&expr)) {
+            VariableType lhs = check(binary->lhs), rhs = check(binary->rhs);
+            for (VariableType type : { lhs, rhs }) {
+                if (type != VariableType::Integer && type != VariableType::Double)
+                    fail(string("arithmetic on ") + typeName(type));
+            }
+            switch (binary->op) {
+                case TPLUS: case TMINUS: case TMUL: case TDIV:
+                    return lhs == VariableType::Double || rhs == VariableType::Double ? VariableType::Double : VariableType::Integer;
+                default:
+                    /* Comparisons are 0 or 1 */
+                    return VariableType::Integer;
+            }
+        }
+        if (NAssignment *assignment = dynamic_cast<NAssignment *>(&expr)) {
+            string name = assignment->lhs.refs.front()->name.str();
+            if (assignment->lhs.refs.size() == 1) {
+                check(assignment->rhs);
+                map<string, VariableType>::iterator it = locals.find(name);
+                if (it == locals.end()) {
+                    fail("assignment to undeclared " + name);
+                    return assignment->rhs.type;
+                }
+                expect(assignment->rhs, it->second, "assignment to " + name);
+                assignment->lhs.type = it->second;
+                return it->second;
+            }
+            check(assignment->lhs);
+            /* Slots hold objects, everything else is boxed */
+            if (check(assignment->rhs) == VariableType::Void)
+                fail("assignment of nothing to a slot of " + name);
+            return assignment->rhs.type;
+        }
+        if (NBlock *block = dynamic_cast<NBlock *>(&expr))
+            return checkBlock(*block);
+
+        fail(string("unknown expression ") + typeid(expr).name());
+        return VariableType::Void;
+    }
+
+    VariableType checkStatement(NStatement& stmt) {
+        if (NExpressionStatement *expr = dynamic_cast<NExpressionStatement *>(&stmt))
+            return check(expr->expression);
+
+        if (NReturnStatement *ret = dynamic_cast<NReturnStatement *>(&stmt)) {
+            check(ret->expression);
+            /* The value of the top level code is not used */
+            if (topLevel) return ret->expression.type;
+            if (returnType == VariableType::Any) returnTypes.push_back(ret->expression.type);
+            else expect(ret->expression, returnType, "return");
+            return ret->expression.type;
+        }
+
+        if (NVariableDeclaration *decl = dynamic_cast<NVariableDeclaration *>(&stmt)) {
+            if (decl->type == VariableType::Void) fail("variable " + decl->id.name.str() + " of type yok");
+            if (decl->type == VariableType::Any) {
+                /* herhangi variables take the type of their initial value */
+                VariableType type = decl->assignmentExpr ? check(*decl->assignmentExpr) : VariableType::Void;
+                if (type == VariableType::Void) fail("variable " + decl->id.name.str() + " of type herhangi needs a value");
+                locals[decl->id.name.str()] = type;
+                return type;
+            }
+            locals[decl->id.name.str()] = decl->type;
+            if (decl->assignmentExpr != NULL) {
+                check(*decl->assignmentExpr);
+                expect(*decl->assignmentExpr, decl->type, "initializer of " + decl->id.name.str());
+            }
+            return decl->type;
+        }
+
+        if (NExternDeclaration *decl = dynamic_cast<NExternDeclaration *>(&stmt)) {
+            declare(decl->id.name.str(), decl->type, decl->arguments);
+            for (NVariableDeclaration *argument : decl->arguments) {
+                if (argument->type == VariableType::Any) fail("extern " + decl->id.name.str() + " with a herhangi argument");
+            }
+            if (decl->type == VariableType::Any) fail("extern " + decl->id.name.str() + " returning herhangi");
+            return VariableType::Void;
+        }
+
+        if (NIfStatement *ifStatement = dynamic_cast<NIfStatement *>(&stmt)) {
+            checkCondition(*ifStatement->condition, "eğer");
+            checkBlock(ifStatement->thenBlock);
+            if (ifStatement->elseBlock) checkBlock(*ifStatement->elseBlock);
+            return VariableType::Void;
+        }
+
+        if (NLoopStatement *loop = dynamic_cast<NLoopStatement *>(&stmt)) {
+            if (loop->init) checkStatement(*loop->init);
+            if (loop->condition) checkCondition(*loop->condition, loop->init || loop->step ? "çevrim" : "sürece");
+            if (loop->step) check(*loop->step);
+            loops++;
+            checkBlock(loop->block);
+            loops--;
+            return VariableType::Void;
+        }
+
+        if (NSwitchStatement *switchStatement = dynamic_cast<NSwitchStatement *>(&stmt)) {
+            checkSwitch(*switchStatement);
+            return VariableType::Void;
+        }
+
+        if (dynamic_cast<NBreakStatement *>(&stmt) || dynamic_cast<NContinueStatement *>(&stmt)) {
+            if (loops == 0) fail(string(dynamic_cast<NBreakStatement *>(&stmt) ? "çık" : "atla") + " outside of a loop");
+            return VariableType::Void;
+        }
+
+        /* Generic functions are checked for each call, see specialize() */
+        if (NFunctionDeclaration *decl = dynamic_cast<NFunctionDeclaration *>(&stmt)) {
+            declare(*decl);
+            if (!decl->isGeneric()) {
+                vector<VariableType> types;
+                for (NVariableDeclaration *argument : decl->arguments)
+                    types.push_back(argument->type);
+                checkFunction(*decl, types);
+            }
+            return VariableType::Void;
+        }
+
+        fail(string("unknown statement ") + typeid(stmt).name());
+        return VariableType::Void;
+    }
+
+    /* Switches are on sayı or yazı values, every literal appears once */
+    void checkSwitch(NSwitchStatement& statement) {
+        VariableType type = check(*statement.value);
+        bool valid = type == VariableType::Integer || type == VariableType::String;
+        if (!valid) fail(string("şartlıgir on ") + typeName(type));
+        set<long long> integers;
+        set<string> strings;
+        for (NSwitchCase *switchCase : statement.cases) {
+            for (NExpression *value : switchCase->values) {
+                string literal;
+                bool duplicate;
+                if (NInteger *integer = dynamic_cast<NInteger *>(value)) {
+                    value->type = VariableType::Integer;
+                    literal = to_string(integer->value);
+                    duplicate = !integers.insert(integer->value).second;
+                } else {
+                    NString *str = static_cast<NString *>(value);
+                    value->type = VariableType::String;
+                    literal = "\"" + str->value.str() + "\"";
+                    duplicate = !strings.insert(str->value.str()).second;
+                    if (strhash(str->value.data()) == StringHashNull)
+                        fail("durum " + literal + " has the hash of a null yazı");
+                }
+                if (valid && value->type != type)
+                    fail("durum " + literal + " of a şartlıgir on " + typeName(type));
+                if (duplicate) fail("durum " + literal + " appears twice");
+            }
+            checkBlock(switchCase->block);
+        }
+        if (statement.defaultBlock) checkBlock(*statement.defaultBlock);
+    }
+
+    VariableType checkBlock(NBlock& block) {
+        VariableType last = VariableType::Void;
+        for (NStatement *statement : block.statements)
+            last = checkStatement(*statement);
+        return last;
+    }
+
+    /* Checks the body of the function for the types of its arguments,
+       returns its return type */
+    VariableType checkFunction(NFunctionDeclaration& function, const vector<VariableType>& types) {
+        map<string, VariableType> outerLocals;
+        outerLocals.swap(locals);
+        vector<VariableType> outerReturnTypes;
+        outerReturnTypes.swap(returnTypes);
+        VariableType outerReturnType = returnType;
+        string outerFunction = this->function;
+        bool outerTopLevel = topLevel;
+        int outerLoops = loops;
+
+        this->function = function.id.name.str();
+        if (function.isGeneric()) {
+            this->function += "<";
+            for (size_t i = 0; i < types.size(); i++)
+                this->function += string(i ? "," : "") + typeName(types[i]);
+            this->function += ">";
+        }
+        for (size_t i = 0; i < function.arguments.size(); i++)
+            locals[function.arguments[i]->id.name.str()] = types[i];
+        returnType = function.type;
+        topLevel = false;
+        loops = 0;
+        checkBlock(function.block);
+        VariableType result = returnType;
+        if (returnType == VariableType::Any)
+            result = joinReturnTypes(function.id.name.str());
+
+        locals.swap(outerLocals);
+        returnTypes.swap(outerReturnTypes);
+        returnType = outerReturnType;
+        this->function = outerFunction;
+        topLevel = outerTopLevel;
+        loops = outerLoops;
+        return result;
+    }
+
+    /* Return type of a herhangi function: the type all its return
+       statements have, double when some of them return integers */
+    VariableType joinReturnTypes(const string& name) {
+        if (returnTypes.empty()) return VariableType::Void;
+        VariableType result = returnTypes.front();
+        for (VariableType type : returnTypes) {
+            if (type == result) continue;
+            bool numeric = (type == VariableType::Integer || type == VariableType::Double) &&
+                           (result == VariableType::Integer || result == VariableType::Double);
+            if (numeric) {
+                result = VariableType::Double;
+            } else {
+                fail(name + " returns both " + typeName(result) + " and " + typeName(type));
+                break;
+            }
+        }
+        return result;
+    }
+
+    /* Binds the herhangi arguments of a generic function to the types of
+       the arguments of the call and checks the function for them, once
+       for every combination. Code generation compiles one function for
+       every specialization recorded here. */
+    VariableType specialize(NFunctionDeclaration& function, NMethodCall& call) {
+        string name = function.id.name.str();
+        if (function.arguments.size() != call.arguments.size()) {
+            fail(name + " takes " + to_string(function.arguments.size()) + " arguments, got " +
+                 to_string(call.arguments.size()));
+            return VariableType::Void;
+        }
+        vector<VariableType> types;
+        for (size_t i = 0; i < call.arguments.size(); i++) {
+            VariableType type = function.arguments[i]->type;
+            if (type == VariableType::Any) {
+                type = call.arguments[i]->type;
+                if (type == VariableType::Void) fail("argument " + to_string(i + 1) + " of " + name + " has no value");
+            } else {
+                expect(*call.arguments[i], type, "argument " + to_string(i + 1) + " of " + name);
+            }
+            types.push_back(type);
+        }
+
+        map<vector<VariableType>, VariableType>::iterator it = function.specializations.find(types);
+        if (it != function.specializations.end()) return it->second;
+        pair<NFunctionDeclaration *, vector<VariableType>> key(&function, types);
+        if (checking.count(key)) {
+            if (function.type == VariableType::Any) {
+                fail("recursive " + name + " needs a return type other than herhangi");
+                return VariableType::Void;
+            }
+            return function.type;
+        }
+        checking.insert(key);
+        VariableType result = checkFunction(function, types);
+        checking.erase(key);
+        function.specializations[types] = result;
+        return result;
+    }
+
+public:
+    TypeChecker() : returnType(VariableType::Void), function("main"), topLevel(true), loops(0), failed(false) {
+        /* The core functions of corefn.cpp */
+        functions["sayi_yaz"] = Signature { VariableType::Void, { VariableType::Integer } };
+        functions["yazi_yaz"] = Signature { VariableType::Void, { VariableType::String } };
+    }
+
+    bool checkProgram(NBlock& program) {
+        /* Functions can be called before their declaration */
+        for (NStatement *statement : program.statements) {
+            if (NFunctionDeclaration *decl = dynamic_cast<NFunctionDeclaration *>(statement))
+                declare(*decl);
+        }
+        program.type = checkBlock(program);
+        return !failed;
+    }
+};
+
+bool checkTypes(NBlock& program)
+{
+    TRACE_SCOPE("codegen", "checkTypes");
+    TypeChecker checker;
+    return checker.checkProgram(program);
+}
@@ -0,0 +1,18 @@
+#ifndef typecheck_h
+#define typecheck_h
+
+#include "node.h"
+
+/* Assigns the static type of every expression of the program to
+   NExpression::type and logs the type errors, returns false when there
+   are any. Integers are promoted to doubles where a double is expected;
+   numbers and strings are boxed where an object is expected and unboxed
+   from objects where a number or string is expected. Generic functions
+   are checked for every combination of argument types they are called
+   with, the types of their expressions are those of the last one. */
+bool checkTypes(NBlock& program);
+
+/* Name of the type in the language, e.g. sayı */
+const char *typeName(VariableType type);
+
+#endif // typecheck_h
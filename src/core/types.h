@@ -1,41 +1,179 @@
 #ifndef types_h
 #define types_h
 
-#include <map>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Version of the interface between generated code and the runtime: the
+   object and box layouts, the shapes, the allocation and slot functions
+   and the caches. Cached objects built for another version are not used,
+   bump it with every change of these. */
+#define RUNTIME_ABI_VERSION 2
+
 struct mObject;
-typedef std::map<char*, mObject*> slotmap;
 
+/* Slot names are interned, every name has a unique small ID in the process */
+typedef uint32_t SymbolID;
+typedef std::unordered_map<SymbolID, mObject*> slotmap;
+
+SymbolID internSymbol(const char *name);
+const char *symbolName(SymbolID symbol);
+
+/* Slots stored in the object itself, the rest go to the overflow array */
+#define InlineSlotCount 4
+
+struct Shape;
+
+/* Objects with the same slots added in the same order share a shape,
+   which maps every slot to an index of the slot storage. Objects with
+   too many slots switch to dictionary mode, their shape is NULL then. */
 struct mObject {
 	struct mObject *prototype;
-	slotmap *slots;
+	struct Shape *shape;
+	union {
+		struct mObject **overflow;
+		slotmap *dictionary;
+	};
+	struct mObject *inlineSlots[InlineSlotCount];
 };
 
 struct cstring {
-	struct mObject *prototype;
-	slotmap *slots;
+	struct mObject object;
 	char *ptr;
 	size_t len;
 };
 
 struct cinteger {
-	struct mObject *prototype;
-	slotmap *slots;
+	struct mObject object;
 	uint64_t value;
 };
 
 struct cdouble {
-	struct mObject *prototype;
-	slotmap *slots;
+	struct mObject object;
 	double value;
 };
 
+#define InlineCacheEntries 4
+/* Shape of the unused cache entries, never the shape of an object */
+#define InlineCacheEmpty ((struct Shape *) UINTPTR_MAX)
+
+enum {
+	InlineCacheRegistered = 1,
+	InlineCacheMegamorphic = 2
+};
+
+struct InlineCacheEntry {
+	struct Shape *shape;
+	uint32_t index;
+};
+
+/* Cache of a getSlot/putSlot call site in generated code, see
+   CodeGenContext::declareRuntime for its LLVM type. The generated code
+   checks the entries itself, the runtime adds new shapes on a miss until
+   the site turns megamorphic. */
+struct InlineCache {
+	struct InlineCacheEntry entries[InlineCacheEntries];
+	uint64_t hits;
+	uint64_t misses;
+	uint32_t count;
+	uint32_t flags;
+	const char *site;
+	struct InlineCache *next;
+};
+
+/* Allocation of runtime objects in the heap of gc.h */
+mObject *objalloc();
+struct cstring *stralloc(char *ptr, size_t len);
+struct cinteger *intalloc(uint64_t value);
+struct cdouble *dblalloc(double value);
+
+/* FNV-1a hash of a string, şartlıgir on yazı dispatches on it. A null
+   yazı hashes to StringHashNull, checkTypes() rejects literals with it. */
+#define StringHashNull 0
+uint64_t strhash(const char *str);
+
+/* Exits with a runtime error unless the object is a box of the kind,
+   one of integerShape, doubleShape and stringShape */
+void checkBox(mObject *object, struct Shape *kind);
+
+/* Exits with the runtime error of an integer division by zero */
+void divisionByZero();
+
+mObject *getSlotCached(mObject *self, SymbolID slot, struct InlineCache *cache);
+void putSlotCached(mObject *self, SymbolID slot, mObject *value, struct InlineCache *cache);
+
 #ifdef __cplusplus
 }
 #endif
 
+/* Calls of the runtime functions, counted while the compiler collects
+   statistics (--time-report, --stats=) */
+struct RuntimeCounters {
+	std::atomic<bool> enabled;
+	std::atomic<uint64_t> getSlot;
+	std::atomic<uint64_t> putSlot;
+	std::atomic<uint64_t> newobj;
+	std::atomic<uint64_t> gcCollections;
+	std::atomic<uint64_t> gcPauseMicros;
+	std::atomic<uint64_t> gcMaxPauseMicros;
+	std::atomic<uint64_t> gcBytesReclaimed;
+};
+
+extern RuntimeCounters runtimeCounters;
+
+/* Counters of an inline cache, kept after its code is freed */
+struct InlineCacheReport {
+	std::string site;
+	uint64_t hits;
+	uint64_t misses;
+	uint32_t entries;
+	bool megamorphic;
+};
+
+/* Caches register themselves on their first miss while the runtime
+   counters are on. Before the code of a program is freed, its thread
+   retires them into the reports. */
+void retireInlineCaches();
+std::vector<InlineCacheReport> inlineCacheReports();
+void clearInlineCacheReports();
+
+/* Shapes form a tree of transitions from the empty shape, each of them
+   adds one slot. They are shared by every thread and never freed. */
+struct Shape {
+	Shape *parent;
+	SymbolID symbol;    // slot added by the transition to this shape
+	uint32_t slotCount;
+	std::unordered_map<SymbolID, uint32_t> indices;
+	std::unordered_map<SymbolID, Shape*> transitions;
+	/* Last transition taken, checked without the lock */
+	std::atomic<Shape*> lastTransition;
+};
+
+/* Shape of new objects, generated code refers to it by name */
+extern "C" Shape emptyShape;
+/* Shapes of the boxes of numbers and strings, unboxing checks them */
+extern "C" Shape integerShape;
+extern "C" Shape doubleShape;
+extern "C" Shape stringShape;
+
+/* Index of the slot in objects of the shape, or -1 */
+static inline int shapeIndex(const Shape *shape, SymbolID slot)
+{
+	std::unordered_map<SymbolID, uint32_t>::const_iterator it = shape->indices.find(slot);
+	return it == shape->indices.end() ? -1 : (int) it->second;
+}
+
+static inline mObject **slotAddress(mObject *object, uint32_t index)
+{
+	return index < InlineSlotCount ? &object->inlineSlots[index] : &object->overflow[index - InlineSlotCount];
+}
+
 #endif // types_h
@@ -3,6 +3,21 @@
 %locations
 %define api.pure full
 
+/* The scanner and the root of the AST are passed to the parser instead of
+   being globals, so several programs can be parsed at the same time. */
+%lex-param { void *scanner }
+%parse-param { void *scanner } { NBlock **programBlock }
+
+/* Identifiers and string literals refer to the source buffer, the nodes
+   built from them copy the text into the arena */
+%code requires {
+    #include <cstddef>
+    struct TokenText {
+        const char *text;
+        size_t length;
+    };
+}
+
 %{
     #include "../core/node.h"
     #include <cstdio>
@@ -11,9 +26,12 @@
     #define ANSI_COLOR_YELLOW  "\x1b[33m"
     #define ANSI_COLOR_RESET   "\x1b[0m"
 
-    NBlock *programBlock; /* the top level root node of our final AST */
-    extern int yylex(union YYSTYPE*, struct YYLTYPE*);
-    void yyerror (struct  YYLTYPE *llocp, const char *s);
+    /* Nodes and lists all live in the parser's arena, see parseProgram(),
+       and are freed together with it */
+    #define NEW_LIST(type) Arena::current()->create<type>()
+
+    extern int yylex(union YYSTYPE*, struct YYLTYPE*, void *scanner);
+    void yyerror (struct  YYLTYPE *llocp, void *scanner, NBlock **programBlock, const char *s);
 %}
 
 /* Represents the many different ways we can access our data */
@@ -27,7 +45,10 @@
     VariableList *varvec;
     ExpressionList *exprvec;
     NReference *ref;
-    std::string *string;
+    NSwitchStatement *switch_stmt;
+    TokenText text;
+    long long integer;
+    double number;
     int token;
     VariableType vartype;
 }
@@ -36,7 +57,9 @@
    match our lexer.l lex file. We also define the node type
    they represent.
  */
-%token <string> TIDENTIFIER TINTEGER TDOUBLE TSTRING
+%token <text> TIDENTIFIER TSTRING
+%token <integer> TINTEGER
+%token <number> TDOUBLE
 %token <token> TCEQ TCNE TCLT TCLE TCGT TCGE TEQUAL
 %token <token> TLPAREN TRPAREN TLBRACE TRBRACE TCOMMA TDOT
 %token <token> TPLUS TMINUS TMUL TDIV
@@ -44,7 +67,7 @@
 %token <token> TBREAK TCASE TCONST TCONTINUE TDEFAULT TDO TELSE TENUM
 %token <token> TFOR TIF TSWITCH TVOID TWHILE TFOREACH TNOT TLOOP TIN
 %token <token> TTRUE TFALSE
-%token <token>  TINTEGERKEY TDOUBLEKEY TSTRINGKEY TOBJECTKEY
+%token <token>  TINTEGERKEY TDOUBLEKEY TSTRINGKEY TOBJECTKEY TANYKEY
 
 /* Define the type of node our nonterminal symbols represent.
    The types refer to the %union declaration above. Ex: when
@@ -53,15 +76,18 @@
  */
 %type <ident> ident
 %type <ref> ref
-%type <expr> numeric expr
+%type <expr> numeric expr case_value
 %type <varvec> func_decl_args
-%type <exprvec> call_args
+%type <exprvec> call_args case_values
+%type <switch_stmt> cases
 %type <block> program stmts block
-%type <stmt> stmt var_decl func_decl extern_decl
+%type <stmt> stmt var_decl func_decl extern_decl if_stmt loop_stmt for_init switch_stmt
 %type <token> comparison
 %type <vartype> var_type
 
-/* Operator precedence for mathematical operators */
+/* Operator precedence for mathematical operators, comparisons bind
+   weaker than arithmetic */
+%nonassoc TCEQ TCNE TCLT TCLE TCGT TCGE
 %left TPLUS TMINUS
 %left TMUL TDIV
 
@@ -69,28 +95,66 @@
 
 %%
 
-program : stmts { programBlock = $1; }
+program : stmts { *programBlock = $1; }
         ;
 
 stmts : stmt { $$ = new NBlock(); $$->statements.push_back($<stmt>1); }
     | stmts stmt { $1->statements.push_back($<stmt>2); }
     ;
 
-stmt : var_decl | func_decl | extern_decl
+stmt : var_decl | func_decl | extern_decl | if_stmt | loop_stmt | switch_stmt
    | expr { $$ = new NExpressionStatement(*$1); }
    | TRETURN expr { $$ = new NReturnStatement(*$2); }
+   | TBREAK { $$ = new NBreakStatement(); }
+   | TCONTINUE { $$ = new NContinueStatement(); }
    ;
 
 block : TLBRACE stmts TRBRACE { $$ = $2; }
     | TLBRACE TRBRACE { $$ = new NBlock(); }
     ;
 
+if_stmt : TIF TLPAREN expr TRPAREN block { $$ = new NIfStatement($3, *$5); }
+        | TIF TLPAREN expr TRPAREN block TELSE block { $$ = new NIfStatement($3, *$5, $7); }
+        | TIF TLPAREN expr TRPAREN block TELSE if_stmt
+            { NBlock *elseBlock = new NBlock(); elseBlock->statements.push_back($7);
+              $$ = new NIfStatement($3, *$5, elseBlock); }
+        ;
+
+loop_stmt : TWHILE TLPAREN expr TRPAREN block { $$ = new NLoopStatement(NULL, $3, NULL, *$5); }
+          | TFOR TLPAREN for_init TCOMMA expr TCOMMA expr TRPAREN block
+              { $$ = new NLoopStatement($3, $5, $7, *$9); }
+          | TLOOP block { $$ = new NLoopStatement(NULL, NULL, NULL, *$2); }
+          ;
+
+/* kabul comes after the durum blocks */
+switch_stmt : TSWITCH TLPAREN expr TRPAREN TLBRACE cases TRBRACE { $6->value = $3; $$ = $6; }
+            | TSWITCH TLPAREN expr TRPAREN TLBRACE cases TDEFAULT block TRBRACE
+                { $6->value = $3; $6->defaultBlock = $8; $$ = $6; }
+            ;
+
+cases : /*blank*/ { $$ = new NSwitchStatement(); }
+      | cases TCASE case_values block { $1->cases.push_back(new NSwitchCase(*$3, *$4)); }
+      ;
+
+case_values : case_value { $$ = NEW_LIST(ExpressionList); $$->push_back($1); }
+            | case_values TCOMMA case_value { $1->push_back($3); }
+            ;
+
+case_value : TINTEGER { $$ = new NInteger($1); }
+           | TMINUS TINTEGER { $$ = new NInteger(-$2); }
+           | TSTRING { $$ = new NString(llvm::StringRef($1.text, $1.length)); }
+           ;
+
+for_init : var_decl
+         | expr { $$ = new NExpressionStatement(*$1); }
+         ;
+
 var_decl : var_type ident { $$ = new NVariableDeclaration($1, *$2); }
          | var_type ident TEQUAL expr { $$ = new NVariableDeclaration($1, *$2, $4); }
          ;
 
 extern_decl : TEXTERN var_type ident TLPAREN func_decl_args TRPAREN
-                { $$ = new NExternDeclaration($2, *$3, *$5); delete $5; }
+                { $$ = new NExternDeclaration($2, *$3, *$5); }
             ;
 
 var_type : TINTEGERKEY { $$ = VariableType::Integer; }
@@ -98,14 +162,15 @@ var_type : TINTEGERKEY { $$ = VariableType::Integer; }
          | TSTRINGKEY { $$ = VariableType::String; }
          | TOBJECTKEY { $$ = VariableType::Object; }
          | TVOID { $$ = VariableType::Void; }
+         | TANYKEY { $$ = VariableType::Any; }
          ;
 
 func_decl : var_type ident TLPAREN func_decl_args TRPAREN block
-      { $$ = new NFunctionDeclaration($1, *$2, *$4, *$6); delete $4; }
+      { $$ = new NFunctionDeclaration($1, *$2, *$4, *$6); }
       ;
 
-func_decl_args : /*blank*/  { $$ = new VariableList(); }
-      | var_decl { $$ = new VariableList(); $$->push_back($<var_decl>1); }
+func_decl_args : /*blank*/  { $$ = NEW_LIST(VariableList); }
+      | var_decl { $$ = NEW_LIST(VariableList); $$->push_back($<var_decl>1); }
       | func_decl_args TCOMMA var_decl { $1->push_back($<var_decl>3); }
       ;
 
@@ -113,29 +178,29 @@ ref : ident { $$ = new NReference(); $$->refs.push_back($1); }
     | ref TDOT ident { $1->refs.push_back($3); }
     ;
 
-ident : TIDENTIFIER { $$ = new NIdentifier(*$1); delete $1; }
+ident : TIDENTIFIER { $$ = new NIdentifier(llvm::StringRef($1.text, $1.length)); }
       ;
 
 expr : ref TEQUAL expr { $$ = new NAssignment(*$1, *$3); }
-     | ref TLPAREN call_args TRPAREN { $$ = new NMethodCall(*$1, *$3); delete $3; }
+     | ref TLPAREN call_args TRPAREN { $$ = new NMethodCall(*$1, *$3); }
      | ref { $<ref>$ = $1; }
      | numeric
-     | TSTRING { $$ = new NString(*$1); }
+     | TSTRING { $$ = new NString(llvm::StringRef($1.text, $1.length)); }
      | expr TMUL expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
      | expr TDIV expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
      | expr TPLUS expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
      | expr TMINUS expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
-     | expr comparison expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
+     | expr comparison expr %prec TCEQ { $$ = new NBinaryOperator(*$1, $2, *$3); }
      | TLPAREN expr TRPAREN { $$ = $2; }
      | block
      ;
 
-numeric : TINTEGER { $$ = new NInteger(atol($1->c_str())); delete $1; }
-        | TDOUBLE { $$ = new NDouble(atof($1->c_str())); delete $1; }
+numeric : TINTEGER { $$ = new NInteger($1); }
+        | TDOUBLE { $$ = new NDouble($1); }
         ;
 
-call_args : /*blank*/  { $$ = new ExpressionList(); }
-      | expr { $$ = new ExpressionList(); $$->push_back($1); }
+call_args : /*blank*/  { $$ = NEW_LIST(ExpressionList); }
+      | expr { $$ = NEW_LIST(ExpressionList); $$->push_back($1); }
       | call_args TCOMMA expr  { $1->push_back($3); }
       ;
 
@@ -143,11 +208,11 @@ comparison : TCEQ | TCNE | TCLT | TCLE | TCGT | TCGE;
 
 %%
 
-void yyerror(YYLTYPE *llocp, const char *s)
+/* Reports the syntax error, yyparse then returns a non zero status */
+void yyerror(YYLTYPE *llocp, void *scanner, NBlock **programBlock, const char *s)
 {
     std::printf("Satır: " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET " Sütun: " \
                 ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET ":" ANSI_COLOR_RED \
                 " Sözdizimi hatası:" ANSI_COLOR_RESET " %s\n",
                 llocp->first_line, llocp->first_column, s);
-    std::exit(1);
 }
@@ -0,0 +1,181 @@
+#include <fstream>
+#include <mutex>
+#include "language.h"
+/* Before codegen.h, whose using namespace llvm makes Instruction ambiguous */
+#include "vm/bytecode.h"
+#include "vm/interpreter.h"
+#include "vm/tier.h"
+#include "core/arena.h"
+#include "core/codegen.h"
+#include "core/node.h"
+#include "core/objcache.h"
+#include "core/simplify.h"
+#include "core/source.h"
+#include "core/typecheck.h"
+
+using namespace std;
+
+void createCoreFunctions(CodeGenContext& context);
+
+void initializeLanguage()
+{
+    static once_flag initialized;
+    call_once(initialized, []() {
+        InitializeNativeTarget();
+        InitializeNativeTargetAsmPrinter();
+        InitializeNativeTargetAsmParser();
+    });
+}
+
+/* Output path with the given extension next to the input file */
+static string outputPath(const CompilerOptions& options, const string& extension)
+{
+    if (!options.outputFile.empty()) return options.outputFile;
+    string base = options.inputFile.empty() ? "a" : options.inputFile;
+    size_t dot = base.find_last_of('.');
+    if (dot != string::npos && base.find('/', dot) == string::npos)
+        base = base.substr(0, dot);
+    return base + extension;
+}
+
+/* Writes the compiled module in the requested ahead-of-time format */
+static int emitOutput(CodeGenContext& context, const CompilerOptions& options)
+{
+    switch (options.output) {
+        case OutputKind::LLVM:
+            return context.emitLLVM(outputPath(options, ".ll")) ? 0 : 1;
+        case OutputKind::Bitcode:
+            return context.emitBitcode(outputPath(options, ".bc")) ? 0 : 1;
+        case OutputKind::Object:
+            return context.emitObjectFile(outputPath(options, ".o")) ? 0 : 1;
+        case OutputKind::Executable: {
+            string object = options.outputFile + ".o";
+            bool linked = context.emitObjectFile(object) &&
+                linkExecutable(vector<string>(1, object), options.outputFile, options.runtimeLibrary);
+            remove(object.c_str());
+            return linked ? 0 : 1;
+        }
+        default:
+            return 1;
+    }
+}
+
+/* Compiles the functions of the program on several threads, then runs
+   them or links them into an executable */
+static int compileParallel(CodeGenContext& context, const CompilerOptions& options)
+{
+    bool forJIT = options.output == OutputKind::Run;
+    vector<unique_ptr<MemoryBuffer>> objects;
+    if (!context.compileParallel(options.jobs, forJIT, objects))
+        return 1;
+    if (forJIT)
+        return context.runObjects(move(objects));
+
+    vector<string> paths;
+    bool written = true;
+    for (size_t i = 0; i < objects.size(); i++) {
+        string path = options.outputFile + "." + to_string(i) + ".o";
+        ofstream file(path, ios::binary);
+        file.write(objects[i]->getBufferStart(), objects[i]->getBufferSize());
+        written = written && file.good();
+        paths.push_back(path);
+    }
+    bool linked = written && linkExecutable(paths, options.outputFile, options.runtimeLibrary);
+    for (const string& path : paths)
+        remove(path.c_str());
+    return linked ? 0 : 1;
+}
+
+/* Compiles an already parsed program with LLVM and runs it */
+static int runJIT(NBlock& root, Arena& arena, const CompilerOptions& options)
+{
+    initializeLanguage();
+    CodeGenContext context(options);
+    createCoreFunctions(context);
+    bool generated = context.generateCode(root);
+    arena.release();
+    if (!generated || !context.optimize())
+        return 1;
+    return context.runCode();
+}
+
+int runProgram(const string& source, const CompilerOptions& options)
+{
+    SourceBuffer buffer;
+    buffer.assign(source.data(), source.size());
+    return runProgram(buffer, options);
+}
+
+int runProgram(SourceBuffer& source, const CompilerOptions& options)
+{
+    bool parallel = options.jobs > 1 && !options.lazy &&
+        (options.output == OutputKind::Run || options.output == OutputKind::Executable);
+
+    /* Short programs start right away in the interpreter, the JIT
+       is only initialized when a function gets hot */
+    if (options.output == OutputKind::Run && options.tier != Tier::JIT && !options.lazy &&
+        !parallel && options.cacheDirectory.empty()) {
+        Arena arena;
+        NBlock *programBlock = parseProgram(source, arena);
+        if (programBlock == NULL || !checkTypes(*programBlock))
+            return 1;
+        if (options.optLevel > 0)
+            simplifyProgram(*programBlock, arena);
+
+        /* Loops of the top level code would never be promoted, with a
+           tier to promote to such programs run in the JIT right away */
+        BytecodeProgram program;
+        bool interpretable = compileBytecode(*programBlock, program);
+        if (interpretable && !(options.tier == Tier::Auto && program.topLevelLoops)) {
+            TierCompiler tier(*programBlock, options);
+            Interpreter interpreter(program, options.tier == Tier::Auto ? &tier : NULL, options.tierThreshold);
+            return interpreter.run();
+        }
+        if (options.tier == Tier::Interpreter) {
+            LOG(LogLevel::Error, "Program can not be interpreted");
+            return 1;
+        }
+        LOG(LogLevel::Debug, "Falling back to the JIT");
+        return runJIT(*programBlock, arena, options);
+    }
+
+    initializeLanguage();
+    CodeGenContext context(options);
+
+    /* A cached object of an unchanged program skips parsing and code generation */
+    unique_ptr<DiskObjectCache> cache;
+    if (!options.cacheDirectory.empty() && options.output == OutputKind::Run && !options.lazy && !parallel) {
+        cache.reset(new DiskObjectCache(options.cacheDirectory, StringRef(source.data(), source.size()), options));
+        unique_ptr<MemoryBuffer> object = cache->lookup();
+        cache->reportStatistics();
+        if (object) {
+            vector<unique_ptr<MemoryBuffer>> objects;
+            objects.push_back(move(object));
+            return context.runObjects(move(objects));
+        }
+        context.objectCache = cache.get();
+    }
+
+    Arena arena;
+    NBlock *programBlock = parseProgram(source, arena);
+    if (programBlock == NULL || !checkTypes(*programBlock))
+        return 1;
+    if (options.optLevel > 0)
+        simplifyProgram(*programBlock, arena);
+    LOG(LogLevel::Verbose, "Main function");
+
+    createCoreFunctions(context);
+    bool generated = context.generateCode(*programBlock);
+    /* The module does not refer to the AST, free it before optimizing */
+    arena.release();
+    if (!generated)
+        return 1;
+    if (parallel)
+        return compileParallel(context, options);
+    if (!context.optimize())
+        return 1;
+
+    if (options.output != OutputKind::Run)
+        return emitOutput(context, options);
+    return context.runCode();
+}
@@ -0,0 +1,29 @@
+#ifndef language_h
+#define language_h
+
+#include <string>
+#include "options.h"
+
+class Arena;
+class NBlock;
+class SourceBuffer;
+
+/* Library API of the compiler. Every call parses and compiles with a
+   scanner, parser and LLVMContext of its own, so a host can compile and
+   run programs on several threads at the same time. */
+
+/* Initializes the native LLVM target once, safe to call from any thread */
+void initializeLanguage();
+
+/* Parses the program source into the arena, returns NULL on syntax
+   errors. The AST stays valid until the arena is released. */
+NBlock *parseProgram(const std::string& source, Arena& arena);
+/* Parses a mapped or read source buffer in place, see source.h */
+NBlock *parseProgram(SourceBuffer& source, Arena& arena);
+
+/* Compiles the program according to the options and runs or emits it.
+   Returns the exit code of the program, or 1 when compiling fails. */
+int runProgram(const std::string& source, const CompilerOptions& options);
+int runProgram(SourceBuffer& source, const CompilerOptions& options);
+
+#endif // language_h
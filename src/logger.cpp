@@ -0,0 +1,45 @@
+#include "logger.h"
+
+bool Logger::parseLevel(const string& name, LogLevel& type)
+{
+    static const char *names[] = { "disabled", "error", "warning", "info", "debug", "verbose" };
+    for (int i = 0; i <= (int) LogLevel::Verbose; i++) {
+        if (name == names[i] || name == to_string(i)) {
+            type = (LogLevel) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Logger::write(LogLevel type, const string& msg)
+{
+    /* One write per line, so lines of different threads do not mix */
+    string line = string("[") + getLabel(type) + "] " + msg + "\n";
+    switch(type) {
+        case LogLevel::Error:
+            cerr << line << flush;
+            break;
+        default:
+            cout << line << flush;
+    }
+}
+
+const char *Logger::getLabel(LogLevel type)
+{
+    switch(type) {
+        case LogLevel::Disabled:
+            return "DISABLED";
+        case LogLevel::Error:
+            return "\x1b[31mERROR\033[0m";
+        case LogLevel::Warning:
+            return "\x1b[33mWARNING\033[0m";
+        case LogLevel::Info:
+            return "\033[0;32mINFO\033[0m";
+        case LogLevel::Debug:
+            return "\033[0;32mDEBUG\033[0m";
+        case LogLevel::Verbose:
+            return "\033[0;32mVERBOSE\033[0m";
+    }
+    return "";
+}
@@ -1,6 +1,10 @@
 #ifndef logger_h
 #define logger_h
 
+#include <atomic>
+#include <iostream>
+#include <string>
+
 using namespace std;
 
 enum class LogLevel {
@@ -12,57 +16,47 @@ enum class LogLevel {
   Verbose = 5,
 };
 
-class LOG {
+// Messages above this level are compiled out, build with
+// `make LOG_MAX_LEVEL=5` to get verbose messages.
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL 4
+#endif
+
+// True when messages of the level are compiled in and enabled with --log=.
+#define LOG_ENABLED(type) ((int) (type) <= LOG_MAX_LEVEL && Logger::enabled(type))
+
+// The message is only built when its level is enabled, so disabled
+// messages cost a comparison at most.
+#define LOG(type, ...) \
+    do { \
+        if (LOG_ENABLED(type)) \
+            Logger::write(type, __VA_ARGS__); \
+    } while (0)
+
+class Logger {
 public:
-    LOG() {}
-    LOG(LogLevel type, string msg) {
-        msgLevel = type;
-        if(msgLevel <= GlobalLogLevel) {
-            operator << ("[" + getLabel(type) + "] " + msg);
-            opened = true;
-        }
-    }
-    ~LOG() {
-        if(opened) {
-            cout << endl;
-        }
-        opened = false;
+    static bool enabled(LogLevel type) {
+        return (int) type <= level().load(memory_order_relaxed);
     }
-    template<class T>
-    LOG &operator<<(const T &msg) {
-        switch(msgLevel) {
-            case LogLevel::Error:
-                cerr << msg;
-                break;
-            default:
-                cout << msg;
-        }
-        opened = true;
-        return *this;
+
+    static void setLevel(LogLevel type) {
+        level().store((int) type, memory_order_relaxed);
     }
-private:
-    // Change this log level to get different log messages.
-    // You can also disable with `LogLevel::Disable`
-    static const LogLevel GlobalLogLevel = LogLevel::Info;
 
-    bool opened = false;
-    LogLevel msgLevel = LogLevel::Disabled;
-    inline string getLabel(LogLevel type) {
-        switch(type) {
-            case LogLevel::Disabled:
-                return "DISABLED";
-            case LogLevel::Error:
-                return "\x1b[31mERROR\033[0m";
-            case LogLevel::Warning:
-                return "\x1b[33mWARNING\033[0m";
-            case LogLevel::Info:
-                return "\033[0;32mINFO\033[0m";
-            case LogLevel::Debug:
-                return "\033[0;32mDEBUG\033[0m";
-            case LogLevel::Verbose:
-                return "\033[0;32mVERBOSE\033[0m";
-        }
+    /* Parses a level name such as "debug" or its number */
+    static bool parseLevel(const string& name, LogLevel& type);
+
+    /* Writes one message line, errors go to stderr */
+    static void write(LogLevel type, const string& msg);
+
+private:
+    // Runtime level, Info unless changed with --log=.
+    static atomic<int>& level() {
+        static atomic<int> current((int) LogLevel::Info);
+        return current;
     }
+
+    static const char *getLabel(LogLevel type);
 };
 
-#endif  // logger_h
\ No newline at end of file
+#endif  // logger_h
@@ -1,29 +1,170 @@
 #include <iostream>
 #include <locale.h>
-#include "core/codegen.h"
-#include "core/node.h"
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+#include "language.h"
+#include "core/source.h"
+#include "logger.h"
+#include "trace.h"
+#include "server/server.h"
+#include "options.h"
 
 using namespace std;
 
-extern int yyparse();
-extern NBlock* programBlock;
+static void usage(const char *program)
+{
+    cerr << "Kullanım: " << program << " [seçenekler] [dosya]" << endl
+         << "  -O0, -O1, -O2, -O3      optimizasyon seviyesi" << endl
+         << "  -passes=<pass,...>      optimizasyon geçişleri" << endl
+         << "  -c                      nesne dosyası üret" << endl
+         << "  -o <dosya>              çalıştırılabilir dosya üret" << endl
+         << "  --emit-llvm             LLVM IR üret" << endl
+         << "  --emit-bc               LLVM bitcode üret" << endl
+         << "  --runtime=<dosya>       bağlanacak çalışma zamanı kütüphanesi" << endl
+         << "  --cache-dir=<dizin>     derlenmiş kod önbelleği" << endl
+         << "  --lazy                  fonksiyonları ilk çağrıldıklarında derle" << endl
+         << "  -j <sayı>, --jobs=<sayı> fonksiyonları paralel derle (0: çekirdek sayısı)" << endl
+         << "  --tier=auto|vm|jit      yorumlayıcı ve/veya JIT ile çalıştır" << endl
+         << "  --tier-threshold=<sayı> JIT ile derlenmek için gereken çağrı ve döngü sayısı" << endl
+         << "  --server=<soket>        programları Unix soketinden alıp çalıştır" << endl
+         << "  --log=<seviye>          günlük seviyesi (error, warning, info, debug, verbose)" << endl
+         << "  --trace=<dosya>         derleme aşamalarının zaman çizelgesini yaz" << endl
+         << "  --time-report           aşama sürelerini ve sayaçları yazdır" << endl
+         << "  --stats=<dosya>         aşama sürelerini ve sayaçları JSON olarak yaz" << endl;
+}
+
+static bool parseOptions(int argc, char **argv, CompilerOptions& options)
+{
+    bool objectOnly = false;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strlen(arg) == 3 && strncmp(arg, "-O", 2) == 0 && arg[2] >= '0' && arg[2] <= '3') {
+            options.optLevel = arg[2] - '0';
+        } else if (strncmp(arg, "-passes=", 8) == 0) {
+            options.passes = arg + 8;
+        } else if (strcmp(arg, "-c") == 0) {
+            objectOnly = true;
+        } else if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            options.outputFile = argv[++i];
+        } else if (strcmp(arg, "--emit-llvm") == 0) {
+            options.output = OutputKind::LLVM;
+        } else if (strcmp(arg, "--emit-bc") == 0) {
+            options.output = OutputKind::Bitcode;
+        } else if (strncmp(arg, "--runtime=", 10) == 0) {
+            options.runtimeLibrary = arg + 10;
+        } else if (strncmp(arg, "--cache-dir=", 12) == 0) {
+            options.cacheDirectory = arg + 12;
+        } else if (strcmp(arg, "-j") == 0 && i + 1 < argc) {
+            options.jobs = atoi(argv[++i]);
+        } else if (strncmp(arg, "--jobs=", 7) == 0) {
+            options.jobs = atoi(arg + 7);
+        } else if (strcmp(arg, "--tier=auto") == 0) {
+            options.tier = Tier::Auto;
+        } else if (strcmp(arg, "--tier=vm") == 0) {
+            options.tier = Tier::Interpreter;
+        } else if (strcmp(arg, "--tier=jit") == 0) {
+            options.tier = Tier::JIT;
+        } else if (strncmp(arg, "--tier-threshold=", 17) == 0) {
+            options.tierThreshold = strtoul(arg + 17, NULL, 10);
+        } else if (strncmp(arg, "--server=", 9) == 0) {
+            options.serverSocket = arg + 9;
+        } else if (strncmp(arg, "--log=", 6) == 0) {
+            LogLevel level;
+            if (!Logger::parseLevel(arg + 6, level)) {
+                LOG(LogLevel::Error, "Unknown log level: " + string(arg + 6));
+                return false;
+            }
+            /* Messages of the level would not be printed at all */
+            if ((int) level > LOG_MAX_LEVEL) {
+                LOG(LogLevel::Error, "Log level " + string(arg + 6) + " is compiled out, build with LOG_MAX_LEVEL=" +
+                    to_string((int) level));
+                return false;
+            }
+            Logger::setLevel(level);
+        } else if (strncmp(arg, "--trace=", 8) == 0) {
+            options.traceFile = arg + 8;
+        } else if (strcmp(arg, "--time-report") == 0) {
+            options.timeReport = true;
+        } else if (strncmp(arg, "--stats=", 8) == 0) {
+            options.statsFile = arg + 8;
+        } else if (strcmp(arg, "--lazy") == 0) {
+            options.lazy = true;
+        } else if (arg[0] != '-' && options.inputFile.empty()) {
+            options.inputFile = arg;
+        } else {
+            LOG(LogLevel::Error, "Unknown option: " + string(arg));
+            return false;
+        }
+    }
+
+    if (options.output == OutputKind::Run) {
+        if (objectOnly)
+            options.output = OutputKind::Object;
+        else if (!options.outputFile.empty())
+            options.output = OutputKind::Executable;
+    }
+
+    if (options.jobs == 0)
+        options.jobs = max(1u, thread::hardware_concurrency());
 
-void createCoreFunctions(CodeGenContext& context);
+    if (options.runtimeLibrary.empty()) {
+        string program = argv[0];
+        size_t slash = program.find_last_of('/');
+        string dir = slash == string::npos ? "." : program.substr(0, slash);
+        options.runtimeLibrary = dir + "/libruntime.a";
+    }
+    return true;
+}
+
+/* Maps the input file, or reads the program from standard input */
+static bool readSource(const CompilerOptions& options, SourceBuffer& source)
+{
+    if (options.inputFile.empty())
+        return source.readStream(cin);
+    return source.mapFile(options.inputFile);
+}
 
 int main(int argc, char **argv)
 {
     setlocale(LC_ALL, "Turkish");
-    yyparse();
-    LOG(LogLevel::Verbose, "Main function");
 
-    InitializeNativeTarget();
-    InitializeNativeTargetAsmPrinter();
-    InitializeNativeTargetAsmParser();
+    CompilerOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!options.serverSocket.empty())
+        return runServer(options.serverSocket, options, runProgram);
+
+    SourceBuffer source;
+    if (!readSource(options, source))
+        return 1;
+    bool statistics = options.timeReport || !options.statsFile.empty();
+    if (options.traceFile.empty() && !statistics)
+        return runProgram(source, options);
 
-    CodeGenContext context;
-    createCoreFunctions(context);
-    context.generateCode(*programBlock);
-    context.runCode();
+    if (!options.traceFile.empty())
+        Trace::start();
+    if (statistics)
+        Statistics::start();
+    int result;
+    {
+        TRACE_SCOPE("compiler", "total");
+        result = runProgram(source, options);
+    }
 
-    return 0;
+    bool written = true;
+    if (!options.traceFile.empty())
+        written = Trace::stop(options.traceFile);
+    if (statistics) {
+        Statistics::stop();
+        if (options.timeReport)
+            Statistics::printReport(cerr);
+        if (!options.statsFile.empty())
+            written = Statistics::writeJSON(options.statsFile) && written;
+    }
+    return written || result != 0 ? result : 1;
 }
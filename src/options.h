@@ -0,0 +1,59 @@
+#ifndef options_h
+#define options_h
+
+#include <string>
+
+#define COMPILER_VERSION "0.1"
+
+/* What the compiler produces from the program */
+enum class OutputKind {
+    Run,        // JIT compile and run in-process
+    Object,     // native object file (-c)
+    Executable, // object file linked with the runtime library (-o)
+    LLVM,       // textual LLVM IR (--emit-llvm)
+    Bitcode,    // LLVM bitcode (--emit-bc)
+};
+
+/* Which execution tier runs the program */
+enum class Tier {
+    Auto,        // start in the interpreter, promote hot functions to the JIT
+    Interpreter, // bytecode interpreter only (--tier=vm)
+    JIT,         // compile the whole program with LLVM (--tier=jit)
+};
+
+/* Command line options of the compiler binary. */
+struct CompilerOptions {
+    // Optimization level given with -O0..-O3.
+    unsigned optLevel = 0;
+    // Comma separated pass list given with -passes=, overrides the
+    // default pipeline of the optimization level when not empty.
+    std::string passes;
+
+    OutputKind output = OutputKind::Run;
+    // Program source, read from standard input when empty.
+    std::string inputFile;
+    // Path of the emitted file, derived from the input file when empty.
+    std::string outputFile;
+    // Runtime library linked into executables, see --runtime=.
+    std::string runtimeLibrary;
+    // Directory of the compiled code cache given with --cache-dir=,
+    // caching is disabled when empty.
+    std::string cacheDirectory;
+    // Compile each function on its first call with the ORC JIT (--lazy).
+    bool lazy = false;
+    // Number of threads compiling the functions of the program (-j).
+    unsigned jobs = 1;
+    Tier tier = Tier::Auto;
+    // Calls and loop iterations after which the interpreter promotes a function (--tier-threshold=).
+    unsigned long tierThreshold = 1000;
+    // Unix socket the compile server listens on (--server=).
+    std::string serverSocket;
+    // File the trace of the compiler phases is written to (--trace=).
+    std::string traceFile;
+    // Print the time of each phase and the counters (--time-report).
+    bool timeReport = false;
+    // File the phase times and counters are written to as JSON (--stats=).
+    std::string statsFile;
+};
+
+#endif // options_h
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "protocol.h"
+#include "../options.h"
+
+using namespace std;
+
+/* Thin client of the compile server: sends a program and prints what it outputs */
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        cerr << "Kullanım: " << argv[0] << " <soket> [-O0|-O1|-O2|-O3] [--tier=auto|vm|jit] [dosya]" << endl;
+        return 1;
+    }
+
+    Request request;
+    request.optLevel = 0;
+    request.tier = (uint32_t) Tier::Auto;
+    const char *inputFile = NULL;
+    for (int i = 2; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strlen(arg) == 3 && strncmp(arg, "-O", 2) == 0 && arg[2] >= '0' && arg[2] <= '3')
+            request.optLevel = arg[2] - '0';
+        else if (strcmp(arg, "--tier=vm") == 0)
+            request.tier = (uint32_t) Tier::Interpreter;
+        else if (strcmp(arg, "--tier=jit") == 0)
+            request.tier = (uint32_t) Tier::JIT;
+        else if (strcmp(arg, "--tier=auto") == 0)
+            request.tier = (uint32_t) Tier::Auto;
+        else
+            inputFile = arg;
+    }
+
+    stringstream buffer;
+    if (inputFile) {
+        ifstream file(inputFile, ios::binary);
+        if (!file) {
+            cerr << "Could not open " << inputFile << endl;
+            return 1;
+        }
+        buffer << file.rdbuf();
+    } else {
+        buffer << cin.rdbuf();
+    }
+    request.source = buffer.str();
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+    int conn = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (conn < 0 || connect(conn, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        cerr << "Could not connect to " << argv[1] << endl;
+        return 1;
+    }
+    if (!sendRequest(conn, request)) {
+        cerr << "Could not send the program" << endl;
+        return 1;
+    }
+
+    FrameType type;
+    string payload;
+    while (receiveFrame(conn, type, payload)) {
+        switch (type) {
+            case FrameType::Stdout:
+                fwrite(payload.data(), 1, payload.size(), stdout);
+                break;
+            case FrameType::Stderr:
+                fwrite(payload.data(), 1, payload.size(), stderr);
+                break;
+            case FrameType::Exit: {
+                uint32_t code = 0;
+                if (payload.size() == sizeof(code)) memcpy(&code, payload.data(), sizeof(code));
+                fflush(stdout);
+                return (int) ntohl(code);
+            }
+        }
+    }
+    cerr << "Connection to the server was lost" << endl;
+    return 1;
+}
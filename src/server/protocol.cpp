@@ -0,0 +1,79 @@
+#include "protocol.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <unistd.h>
+
+using namespace std;
+
+static const uint32_t MaxPayload = 256 << 20;
+
+bool writeAll(int fd, const void *data, size_t length)
+{
+    const char *ptr = (const char *) data;
+    while (length > 0) {
+        ssize_t written = write(fd, ptr, length);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        ptr += written;
+        length -= written;
+    }
+    return true;
+}
+
+bool readAll(int fd, void *data, size_t length)
+{
+    char *ptr = (char *) data;
+    while (length > 0) {
+        ssize_t count = read(fd, ptr, length);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        ptr += count;
+        length -= count;
+    }
+    return true;
+}
+
+bool sendRequest(int fd, const Request& request)
+{
+    uint32_t header[4] = {
+        htonl(PROTOCOL_MAGIC),
+        htonl(request.optLevel),
+        htonl(request.tier),
+        htonl((uint32_t) request.source.size())
+    };
+    return writeAll(fd, header, sizeof(header)) &&
+           writeAll(fd, request.source.data(), request.source.size());
+}
+
+bool receiveRequest(int fd, Request& request)
+{
+    uint32_t header[4];
+    if (!readAll(fd, header, sizeof(header)) || ntohl(header[0]) != PROTOCOL_MAGIC)
+        return false;
+    request.optLevel = ntohl(header[1]);
+    request.tier = ntohl(header[2]);
+    uint32_t length = ntohl(header[3]);
+    if (length > MaxPayload) return false;
+    request.source.resize(length);
+    return readAll(fd, &request.source[0], length);
+}
+
+bool sendFrame(int fd, FrameType type, const void *data, uint32_t length)
+{
+    uint8_t kind = (uint8_t) type;
+    uint32_t size = htonl(length);
+    return writeAll(fd, &kind, 1) && writeAll(fd, &size, 4) && writeAll(fd, data, length);
+}
+
+bool receiveFrame(int fd, FrameType& type, string& payload)
+{
+    uint8_t kind;
+    uint32_t size;
+    if (!readAll(fd, &kind, 1) || !readAll(fd, &size, 4))
+        return false;
+    size = ntohl(size);
+    if (size > MaxPayload) return false;
+    type = (FrameType) kind;
+    payload.resize(size);
+    return size == 0 || readAll(fd, &payload[0], size);
+}
@@ -0,0 +1,34 @@
+#ifndef protocol_h
+#define protocol_h
+
+#include <cstdint>
+#include <string>
+
+/* Wire format between the compile server and its client. The client sends
+   one request per connection, the server answers with frames carrying the
+   program's output and finally its exit code. */
+
+#define PROTOCOL_MAGIC 0x314c5054 // "TPL1"
+
+enum class FrameType : uint8_t {
+    Stdout = 1,
+    Stderr = 2,
+    Exit = 3,   // payload is the exit code as a 32 bit integer
+};
+
+struct Request {
+    uint32_t optLevel;
+    uint32_t tier;
+    std::string source;
+};
+
+bool writeAll(int fd, const void *data, size_t length);
+bool readAll(int fd, void *data, size_t length);
+
+bool sendRequest(int fd, const Request& request);
+bool receiveRequest(int fd, Request& request);
+
+bool sendFrame(int fd, FrameType type, const void *data, uint32_t length);
+bool receiveFrame(int fd, FrameType& type, std::string& payload);
+
+#endif // protocol_h
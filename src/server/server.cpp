@@ -0,0 +1,149 @@
+#include "server.h"
+#include "protocol.h"
+#include "../core/codegen.h"
+#include "../language.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+void cacheCoreFunctions(const CompilerOptions& options);
+
+/* Sends everything the program writes to its stdout and stderr pipes to the client */
+static void relayOutput(int out, int err, int conn)
+{
+    struct pollfd fds[2] = { { out, POLLIN, 0 }, { err, POLLIN, 0 } };
+    FrameType types[2] = { FrameType::Stdout, FrameType::Stderr };
+    int open = 2;
+    char buffer[16384];
+
+    while (open > 0) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t count = read(fds[i].fd, buffer, sizeof(buffer));
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open--;
+                continue;
+            }
+            sendFrame(conn, types[i], buffer, count);
+        }
+    }
+}
+
+/* Runs the requested program in a child process and reports its output and exit code */
+static int serveConnection(int conn, const CompilerOptions& serverOptions, SourceRunner run)
+{
+    Request request;
+    if (!receiveRequest(conn, request)) {
+        LOG(LogLevel::Warning, "Invalid request");
+        return 1;
+    }
+
+    CompilerOptions options = serverOptions;
+    options.output = OutputKind::Run;
+    options.optLevel = min(request.optLevel, 3u);
+    if (request.tier <= (uint32_t) Tier::JIT)
+        options.tier = (Tier) request.tier;
+
+    int out[2], err[2];
+    if (pipe(out) < 0 || pipe(err) < 0)
+        return 1;
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return 1;
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDONLY);
+        dup2(null, 0);
+        dup2(out[1], 1);
+        dup2(err[1], 2);
+        close(null);
+        close(out[0]); close(out[1]);
+        close(err[0]); close(err[1]);
+        close(conn);
+
+        int status = run(request.source, options);
+        fflush(NULL);
+        _exit(status);
+    }
+
+    close(out[1]);
+    close(err[1]);
+    relayOutput(out[0], err[0], conn);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) { }
+    int32_t code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    uint32_t payload = htonl((uint32_t) code);
+    sendFrame(conn, FrameType::Exit, &payload, sizeof(payload));
+    return 0;
+}
+
+int runServer(const string& socketPath, const CompilerOptions& options, SourceRunner run)
+{
+    initializeLanguage();
+    cacheCoreFunctions(options);
+
+    struct sockaddr_un address;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        LOG(LogLevel::Error, "Socket path is too long: " + socketPath);
+        return 1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+    if (listener < 0 || bind(listener, (struct sockaddr *) &address, sizeof(address)) < 0 ||
+        listen(listener, 64) < 0) {
+        LOG(LogLevel::Error, "Could not listen on " + socketPath + ": " + strerror(errno));
+        return 1;
+    }
+
+    /* Sessions are reaped automatically, a client going away must not kill us */
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    LOG(LogLevel::Info, "Listening on " + socketPath);
+
+    for (;;) {
+        int conn = accept(listener, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            LOG(LogLevel::Error, "Accept failed: " + string(strerror(errno)));
+            break;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listener);
+            signal(SIGCHLD, SIG_DFL);
+            int status = serveConnection(conn, options, run);
+            close(conn);
+            _exit(status);
+        }
+        if (pid < 0)
+            LOG(LogLevel::Warning, "Fork failed: " + string(strerror(errno)));
+        close(conn);
+    }
+
+    close(listener);
+    unlink(socketPath.c_str());
+    return 1;
+}
@@ -0,0 +1,15 @@
+#ifndef server_h
+#define server_h
+
+#include <string>
+#include "../options.h"
+
+/* Compiles and runs one program, returns its exit code */
+typedef int (*SourceRunner)(const std::string& source, const CompilerOptions& options);
+
+/* Keeps LLVM and the core functions warm and runs programs submitted over
+   a Unix socket. Every program runs in its own forked process, so it gets
+   a fresh compiler state and can not take the server down. */
+int runServer(const std::string& socketPath, const CompilerOptions& options, SourceRunner run);
+
+#endif // server_h
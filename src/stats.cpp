@@ -0,0 +1,169 @@
+#include "stats.h"
+#include "logger.h"
+#include "core/types.h"
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+struct PhaseTimes {
+    uint64_t wall = 0;
+    uint64_t cpu = 0;
+    uint64_t runs = 0;
+};
+
+atomic<bool> Statistics::active(false);
+
+static const char *counterNames[] = {
+    "tokens", "astNodes", "foldedConstants", "propagatedConstants", "evaluatedCalls",
+    "unreachableStatements", "unusedDeclarations", "functions", "irInstructions", "optimizedIRInstructions",
+    "machineCodeBytes", "objectBytes", "localObjects", "gcRootSlots", "specializations",
+    "getSlotCalls", "putSlotCalls", "newobjCalls",
+    "inlineCacheHits", "inlineCacheMisses", "megamorphicSites",
+    "gcCollections", "gcPauseUs", "gcMaxPauseUs", "gcBytesReclaimed",
+};
+
+static atomic<uint64_t> counters[(int) Counter::Count];
+static mutex phaseMutex;
+static map<string, PhaseTimes> phases;
+
+void Statistics::start()
+{
+    for (atomic<uint64_t>& counter : counters)
+        counter = 0;
+    {
+        lock_guard<mutex> lock(phaseMutex);
+        phases.clear();
+    }
+    runtimeCounters.getSlot = runtimeCounters.putSlot = runtimeCounters.newobj = 0;
+    runtimeCounters.gcCollections = runtimeCounters.gcPauseMicros = 0;
+    runtimeCounters.gcMaxPauseMicros = runtimeCounters.gcBytesReclaimed = 0;
+    clearInlineCacheReports();
+    runtimeCounters.enabled = true;
+    active = true;
+}
+
+/* Stops counting and takes over the counters of the runtime */
+void Statistics::stop()
+{
+    active = false;
+    runtimeCounters.enabled = false;
+    counters[(int) Counter::GetSlotCalls] += runtimeCounters.getSlot;
+    counters[(int) Counter::PutSlotCalls] += runtimeCounters.putSlot;
+    counters[(int) Counter::NewObjectCalls] += runtimeCounters.newobj;
+    counters[(int) Counter::GCCollections] += runtimeCounters.gcCollections;
+    counters[(int) Counter::GCPauseMicros] += runtimeCounters.gcPauseMicros;
+    counters[(int) Counter::GCMaxPauseMicros] += runtimeCounters.gcMaxPauseMicros;
+    counters[(int) Counter::GCBytesReclaimed] += runtimeCounters.gcBytesReclaimed;
+    retireInlineCaches();
+    for (const InlineCacheReport& report : inlineCacheReports()) {
+        counters[(int) Counter::InlineCacheHits] += report.hits;
+        counters[(int) Counter::InlineCacheMisses] += report.misses;
+        if (report.megamorphic)
+            counters[(int) Counter::MegamorphicSites]++;
+    }
+}
+
+/* Sites with the most misses first */
+static vector<InlineCacheReport> sortedInlineCaches()
+{
+    vector<InlineCacheReport> caches = inlineCacheReports();
+    stable_sort(caches.begin(), caches.end(), [](const InlineCacheReport& a, const InlineCacheReport& b) {
+        return a.misses > b.misses;
+    });
+    return caches;
+}
+
+static double hitRate(const InlineCacheReport& cache)
+{
+    uint64_t total = cache.hits + cache.misses;
+    return total ? 100.0 * cache.hits / total : 0.0;
+}
+
+void Statistics::add(Counter counter, uint64_t value)
+{
+    counters[(int) counter].fetch_add(value, memory_order_relaxed);
+}
+
+void Statistics::addPhase(const char *category, const char *name, uint64_t wall, uint64_t cpu)
+{
+    lock_guard<mutex> lock(phaseMutex);
+    PhaseTimes& phase = phases[string(category) + "." + name];
+    phase.wall += wall;
+    phase.cpu += cpu;
+    phase.runs++;
+}
+
+uint64_t Statistics::threadCPUTime()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return (uint64_t) time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+void Statistics::printReport(ostream& out)
+{
+    lock_guard<mutex> lock(phaseMutex);
+    out << "===== Time report =====" << endl
+        << left << setw(32) << "Phase" << right << setw(12) << "Wall (ms)"
+        << setw(12) << "CPU (ms)" << setw(10) << "Runs" << endl;
+    out << fixed << setprecision(3);
+    for (auto& entry : phases) {
+        out << left << setw(32) << entry.first << right
+            << setw(12) << entry.second.wall / 1000.0 << setw(12) << entry.second.cpu / 1000.0
+            << setw(10) << entry.second.runs << endl;
+    }
+    out << "===== Statistics =====" << endl;
+    for (int i = 0; i < (int) Counter::Count; i++)
+        out << left << setw(32) << counterNames[i] << right << setw(12) << counters[i] << endl;
+
+    /* The report is for finding megamorphic sites, the JSON has every site */
+    vector<InlineCacheReport> caches = sortedInlineCaches();
+    if (caches.empty()) return;
+    out << "===== Inline caches =====" << endl
+        << left << setw(32) << "Site" << right << setw(12) << "Hits" << setw(12) << "Misses"
+        << setw(10) << "Hit %" << setw(10) << "Shapes" << endl;
+    out << setprecision(1);
+    for (size_t i = 0; i < caches.size() && i < 20; i++) {
+        const InlineCacheReport& cache = caches[i];
+        out << left << setw(32) << cache.site << right << setw(12) << cache.hits << setw(12) << cache.misses
+            << setw(10) << hitRate(cache) << setw(10) << cache.entries
+            << (cache.megamorphic ? "  megamorphic" : "") << endl;
+    }
+}
+
+bool Statistics::writeJSON(const string& path)
+{
+    ofstream file(path);
+    if (!file) {
+        LOG(LogLevel::Error, "Could not open " + path);
+        return false;
+    }
+
+    lock_guard<mutex> lock(phaseMutex);
+    file << "{\n  \"phases\": {";
+    bool first = true;
+    for (auto& entry : phases) {
+        file << (first ? "\n" : ",\n") << "    \"" << entry.first << "\": {\"wallUs\": " << entry.second.wall
+             << ", \"cpuUs\": " << entry.second.cpu << ", \"runs\": " << entry.second.runs << "}";
+        first = false;
+    }
+    file << "\n  },\n  \"counters\": {";
+    for (int i = 0; i < (int) Counter::Count; i++)
+        file << (i ? ",\n" : "\n") << "    \"" << counterNames[i] << "\": " << counters[i];
+    file << "\n  },\n  \"inlineCaches\": [";
+    vector<InlineCacheReport> caches = sortedInlineCaches();
+    for (size_t i = 0; i < caches.size(); i++) {
+        const InlineCacheReport& cache = caches[i];
+        file << (i ? ",\n" : "\n") << "    {\"site\": \"" << cache.site << "\", \"hits\": " << cache.hits
+             << ", \"misses\": " << cache.misses << ", \"shapes\": " << cache.entries
+             << ", \"megamorphic\": " << (cache.megamorphic ? "true" : "false") << "}";
+    }
+    file << "\n  ]\n}\n";
+    return file.good();
+}
@@ -0,0 +1,62 @@
+#ifndef stats_h
+#define stats_h
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/* Counters of the work done by the compiler and the runtime */
+enum class Counter {
+    Tokens,
+    ASTNodes,
+    FoldedConstants,    // AST simplification, see simplify.h
+    PropagatedConstants,
+    EvaluatedCalls,     // calls of pure functions run during compilation
+    UnreachableStatements,
+    UnusedDeclarations,
+    Functions,          // functions defined in the generated module
+    IRInstructions,     // after code generation
+    OptimizedIRInstructions,
+    MachineCodeBytes,   // text sections loaded by the JIT
+    ObjectBytes,        // object files emitted
+    LocalObjects,       // objects replaced by locals of their slots
+    GCRootSlots,        // slots of the shadow stack frames, see emitShadowStack
+    Specializations,    // functions generated for generic declarations
+    GetSlotCalls,
+    PutSlotCalls,
+    NewObjectCalls,
+    InlineCacheHits,
+    InlineCacheMisses,
+    MegamorphicSites,
+    GCCollections,
+    GCPauseMicros,
+    GCMaxPauseMicros,
+    GCBytesReclaimed,
+    Count
+};
+
+/* Wall and CPU time per compiler phase plus the counters above, enabled
+   with --time-report and --stats=<file>. Phases are the TRACE_SCOPEs of
+   trace.h, so the report and the trace always agree. */
+class Statistics {
+    static std::atomic<bool> active;
+
+public:
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    static void start();
+    static void stop();
+
+    static void add(Counter counter, uint64_t value);
+    /* Adds one run of a phase, times are in microseconds */
+    static void addPhase(const char *category, const char *name, uint64_t wall, uint64_t cpu);
+
+    /* CPU time of the calling thread in microseconds */
+    static uint64_t threadCPUTime();
+
+    static void printReport(std::ostream& out);
+    static bool writeJSON(const std::string& path);
+};
+
+#endif // stats_h
@@ -0,0 +1,113 @@
+#include "trace.h"
+#include "logger.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+struct TraceEvent {
+    const char *category;
+    const char *name;
+    string detail;
+    uint64_t start;
+    uint64_t end;
+    unsigned thread;
+};
+
+atomic<bool> Trace::active(false);
+
+static mutex finishedMutex;
+static vector<TraceEvent> finishedEvents;
+static atomic<unsigned> nextThread(0);
+
+/* Events of one thread, handed over when the thread exits or tracing stops */
+struct ThreadEvents {
+    unsigned thread;
+    vector<TraceEvent> events;
+
+    ThreadEvents() : thread(nextThread++) { }
+    ~ThreadEvents() { flush(); }
+
+    void flush() {
+        lock_guard<mutex> lock(finishedMutex);
+        for (TraceEvent& event : events)
+            finishedEvents.push_back(move(event));
+        events.clear();
+    }
+};
+
+static thread_local ThreadEvents threadEvents;
+
+void Trace::start()
+{
+    {
+        lock_guard<mutex> lock(finishedMutex);
+        finishedEvents.clear();
+    }
+    threadEvents.events.clear();
+    active = true;
+}
+
+uint64_t Trace::now()
+{
+    return chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char *category, const char *name, const string& detail,
+                   uint64_t start, uint64_t end)
+{
+    threadEvents.events.push_back(TraceEvent { category, name, detail, start, end, threadEvents.thread });
+}
+
+static string escape(const string& text)
+{
+    string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char) c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/* Threads that are still running keep their events, the compiler joins
+   its worker threads before tracing stops */
+bool Trace::stop(const string& path)
+{
+    active = false;
+    threadEvents.flush();
+
+    ofstream file(path);
+    if (!file) {
+        LOG(LogLevel::Error, "Could not open " + path);
+        return false;
+    }
+
+    lock_guard<mutex> lock(finishedMutex);
+    file << "{\"traceEvents\":[";
+    for (size_t i = 0; i < finishedEvents.size(); i++) {
+        const TraceEvent& event = finishedEvents[i];
+        file << (i ? ",\n" : "\n")
+             << "{\"cat\":\"" << event.category << "\",\"name\":\"" << event.name
+             << "\",\"ph\":\"X\",\"pid\":" << getpid() << ",\"tid\":" << event.thread
+             << ",\"ts\":" << event.start << ",\"dur\":" << event.end - event.start;
+        if (!event.detail.empty())
+            file << ",\"args\":{\"detail\":\"" << escape(event.detail) << "\"}";
+        file << "}";
+    }
+    file << "\n]}\n";
+    finishedEvents.clear();
+    return file.good();
+}
@@ -0,0 +1,69 @@
+#ifndef trace_h
+#define trace_h
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "stats.h"
+
+/* Structured trace of the compiler phases, written with --trace=<file> in
+   the Chrome trace event format (chrome://tracing, Perfetto). Events are
+   kept in per-thread buffers and written when tracing stops; while
+   tracing and statistics are off a TRACE_SCOPE costs two loads and a branch. */
+class Trace {
+    static std::atomic<bool> active;
+
+public:
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    static void start();
+    /* Writes the recorded events to the file, returns false on errors */
+    static bool stop(const std::string& path);
+
+    static uint64_t now();
+    static void record(const char *category, const char *name, const std::string& detail,
+                       uint64_t start, uint64_t end);
+};
+
+/* Records the time between its construction and destruction as a
+   complete event, and as a phase of the statistics. The detail, e.g. a
+   function name, is only copied when tracing is on. */
+class TraceScope {
+    const char *category;
+    const char *name;
+    std::string detail;
+    uint64_t start;
+    uint64_t cpuStart;
+    bool tracing;
+    bool timing;
+
+    void begin() {
+        if (tracing || timing) start = Trace::now();
+        if (timing) cpuStart = Statistics::threadCPUTime();
+    }
+
+public:
+    TraceScope(const char *category, const char *name) :
+        category(category), name(name), tracing(Trace::enabled()), timing(Statistics::enabled()) {
+        begin();
+    }
+
+    TraceScope(const char *category, const char *name, const std::string& detail) :
+        category(category), name(name), tracing(Trace::enabled()), timing(Statistics::enabled()) {
+        if (tracing) this->detail = detail;
+        begin();
+    }
+
+    ~TraceScope() {
+        if (!tracing && !timing) return;
+        uint64_t end = Trace::now();
+        if (tracing) Trace::record(category, name, detail, start, end);
+        if (timing) Statistics::addPhase(category, name, end - start, Statistics::threadCPUTime() - cpuStart);
+    }
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
+
+#endif // trace_h
@@ -0,0 +1,125 @@
+#ifndef bytecode_h
+#define bytecode_h
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include "../core/node.h"
+#include "../core/types.h"
+
+/* A register holds one untagged 64 bit value. The bytecode compiler knows
+   the static type of every register and picks typed instructions. */
+union VMValue {
+    int64_t integer;
+    double number;
+    const char *string;
+    mObject *object;
+};
+
+enum class OpCode : uint16_t {
+    LoadConst,   // R[a] = K[b]
+    Move,        // R[a] = R[b]
+    AddInt,      // R[a] = R[b] + R[c]
+    SubInt,
+    MulInt,
+    DivInt,
+    AddDouble,
+    SubDouble,
+    MulDouble,
+    DivDouble,
+    IntToDouble, // R[a] = (double) R[b]
+    EqualInt,    // R[a] = R[b] == R[c] ? 1 : 0, > and >= swap the operands
+    NotEqualInt,
+    LessInt,
+    LessEqualInt,
+    EqualDouble,
+    NotEqualDouble,
+    LessDouble,
+    LessEqualDouble,
+    Jump,        // continue at code[a]
+    Loop,        // Jump back to the top of a loop, counts toward promotion
+    JumpIfFalse, // continue at code[b] when R[a] is zero
+    JumpTable,   // continue at the target of R[a] in switchTables[b], see SwitchTable
+    SearchTable,
+    HashString,  // R[a] = strhash(R[b])
+    EqualString, // R[a] = strcmp(R[b], R[c]) == 0 ? 1 : 0
+    Box,         // R[a] = R[b] boxed like in codegen, c is the VariableType of R[b]
+    Unbox,       // R[a] = R[b] unboxed to VariableType c, checked by shape, null gives zero
+    NewObject,   // R[a] = newobj(NULL)
+    GetSlot,     // R[a] = getSlot(R[b], K[c], 1), K[c] is a SymbolID
+    PutSlot,     // putSlot(R[a], K[b], R[c]), K[b] is a SymbolID
+    Call,        // R[a] = functions[b](R[c], R[c + 1], ...)
+    CallNative,  // R[a] = natives[b](R[c], R[c + 1], ...)
+    SetReturn,   // return value = R[a], a Return follows for döndür
+    Return,      // return the return value
+};
+
+/* Register based instruction, operands are registers, constants or
+   function indices depending on the opcode. */
+struct Instruction {
+    OpCode op;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+};
+
+/* Targets of a şartlıgir. A jump table has a target for every key from
+   low on, a search table the sorted keys of the cases and their targets,
+   found by binary search. Keys without a case continue at otherwise. */
+struct SwitchTable {
+    int64_t low;
+    std::vector<int64_t> keys;
+    std::vector<uint16_t> targets;
+    uint16_t otherwise;
+};
+
+/* Entry of a function promoted to machine code. Arguments and the
+   return value are passed as raw 64 bit register values. */
+typedef int64_t (*JITEntry)(int64_t *args);
+
+struct FunctionProto {
+    std::string name;
+    NFunctionDeclaration *declaration;
+    std::vector<Instruction> code;
+    std::vector<VMValue> constants;
+    std::vector<SwitchTable> switchTables;
+    std::deque<std::string> strings; // storage of string constants
+    uint16_t numArgs;
+    uint16_t numRegisters;
+
+    /* Tiering state, calls and loop iterations count toward promotion */
+    uint64_t callCount;
+    bool jitFailed;
+    JITEntry jitEntry;
+
+    FunctionProto() : declaration(NULL), numArgs(0), numRegisters(0),
+                      callCount(0), jitFailed(false), jitEntry(NULL) { }
+};
+
+typedef int64_t (*NativeFunction)(int64_t *args);
+
+struct NativeProto {
+    std::string name;
+    uint16_t numArgs;
+    NativeFunction function;
+    void *external; // address of an extern declaration
+};
+
+struct BytecodeProgram {
+    std::vector<FunctionProto *> functions; // functions[0] is the top level code
+    std::vector<NativeProto> natives;
+    /* The top level code runs once, its loops are never promoted */
+    bool topLevelLoops;
+
+    BytecodeProgram() : topLevelLoops(false) { }
+    ~BytecodeProgram() {
+        for (FunctionProto *function : functions) delete function;
+    }
+};
+
+/* Compiles the AST into bytecode, returns false when the program uses
+   something the interpreter does not support. */
+bool compileBytecode(NBlock& root, BytecodeProgram& program);
+
+#endif // bytecode_h
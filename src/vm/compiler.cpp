@@ -0,0 +1,630 @@
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <typeinfo>
+#include <dlfcn.h>
+#include "bytecode.h"
+#include "../grammar/parser.hpp"
+#include "../logger.h"
+#include "../trace.h"
+
+using namespace std;
+
+/* Register and static type of a compiled expression */
+struct Operand {
+    uint16_t reg;
+    VariableType type;
+};
+
+static const uint16_t MaxRegisters = 0xffff;
+/* Jump targets are instruction indices in 16 bit operands */
+static const size_t MaxCodeSize = 0xffff;
+
+/* Switches with at least this many keys, covering at least 40% of the
+   range between the lowest and the highest, dispatch through a jump
+   table. Others and yazı switches, whose keys are hashes, search. */
+static const size_t MinJumpTableKeys = 4;
+static const uint64_t MaxJumpTableSize = 4096;
+
+static bool isDense(const map<int64_t, size_t>& keys)
+{
+    if (keys.size() < MinJumpTableKeys) return false;
+    uint64_t range = (uint64_t) keys.rbegin()->first - (uint64_t) keys.begin()->first + 1;
+    return range != 0 && range <= MaxJumpTableSize && range * 2 <= keys.size() * 5;
+}
+
+/* Jumps of çık and atla in a loop, patched when the loop is compiled */
+struct LoopJumps {
+    vector<size_t> breaks;
+    vector<size_t> continues;
+};
+
+class BytecodeCompiler {
+    BytecodeProgram& program;
+    map<string, uint16_t> functions;
+    map<string, uint16_t> natives;
+    map<string, VariableList *> parameters;
+    map<string, VariableType> returnTypes;
+
+    /* State of the function being compiled */
+    FunctionProto *proto;
+    map<string, Operand> locals;
+    uint16_t localsTop;
+    uint16_t nextRegister;
+    vector<LoopJumps> loops;
+    bool failed;
+
+    bool fail(const string& reason) {
+        if (!failed) LOG(LogLevel::Debug, "Bytecode compiler: " + reason);
+        failed = true;
+        return false;
+    }
+
+    uint16_t allocateRegister() {
+        if (nextRegister == MaxRegisters) {
+            fail("too many registers");
+            return 0;
+        }
+        uint16_t reg = nextRegister++;
+        if (nextRegister > proto->numRegisters) proto->numRegisters = nextRegister;
+        return reg;
+    }
+
+    uint16_t declareLocal(const string& name, VariableType type) {
+        uint16_t reg = allocateRegister();
+        localsTop = nextRegister;
+        locals[name] = Operand { reg, type };
+        return reg;
+    }
+
+    void emit(OpCode op, uint16_t a, uint16_t b = 0, uint16_t c = 0) {
+        proto->code.push_back(Instruction { op, a, b, c });
+    }
+
+    /* Index of the next instruction, as a jump target */
+    uint16_t label() {
+        if (proto->code.size() > MaxCodeSize) {
+            fail("function too long");
+            return 0;
+        }
+        return proto->code.size();
+    }
+
+    /* Emits a jump whose target is set by patch() */
+    size_t emitJump(OpCode op, uint16_t condition = 0) {
+        emit(op, condition);
+        return proto->code.size() - 1;
+    }
+
+    void patch(size_t jump, uint16_t target) {
+        Instruction& ins = proto->code[jump];
+        if (ins.op == OpCode::Jump)
+            ins.a = target;
+        else
+            ins.b = target;
+    }
+
+    uint16_t addConstant(VMValue value) {
+        if (proto->constants.size() == MaxRegisters) {
+            fail("too many constants");
+            return 0;
+        }
+        proto->constants.push_back(value);
+        return proto->constants.size() - 1;
+    }
+
+    uint16_t addString(const string& str) {
+        proto->strings.push_back(str);
+        VMValue value;
+        value.string = proto->strings.back().c_str();
+        return addConstant(value);
+    }
+
+    /* Slot names are interned when the bytecode is compiled */
+    uint16_t addSymbol(const string& name) {
+        VMValue value;
+        value.integer = internSymbol(name.c_str());
+        return addConstant(value);
+    }
+
+    /* Converts the operand to the expected type when the language allows
+       it, numbers and strings are boxed and unboxed like convert() of
+       codegen does, so JIT code can read the slots the interpreter wrote */
+    Operand convert(Operand operand, VariableType expected) {
+        if (operand.type == expected) return operand;
+        if (operand.type == VariableType::Integer && expected == VariableType::Double) {
+            uint16_t reg = allocateRegister();
+            emit(OpCode::IntToDouble, reg, operand.reg);
+            return Operand { reg, VariableType::Double };
+        }
+        bool primitive = operand.type == VariableType::Integer || operand.type == VariableType::Double ||
+                         operand.type == VariableType::String;
+        if (primitive && expected == VariableType::Object) {
+            uint16_t reg = allocateRegister();
+            emit(OpCode::Box, reg, operand.reg, operand.type);
+            return Operand { reg, VariableType::Object };
+        }
+        if (operand.type == VariableType::Object && (expected == VariableType::Integer ||
+            expected == VariableType::Double || expected == VariableType::String)) {
+            uint16_t reg = allocateRegister();
+            emit(OpCode::Unbox, reg, operand.reg, expected);
+            return Operand { reg, expected };
+        }
+        fail("type mismatch");
+        return operand;
+    }
+
+    Operand compileIdentifier(NIdentifier& ident) {
+        if (ident.name == "null") {
+            VMValue value;
+            value.object = NULL;
+            uint16_t reg = allocateRegister();
+            emit(OpCode::LoadConst, reg, addConstant(value));
+            return Operand { reg, VariableType::Object };
+        }
+
+        map<string, Operand>::iterator it = locals.find(ident.name.str());
+        if (it != locals.end()) return it->second;
+
+        /* Unknown identifiers are new objects, like in codegen */
+        uint16_t reg = declareLocal(ident.name.str(), VariableType::Object);
+        emit(OpCode::NewObject, reg);
+        return Operand { reg, VariableType::Object };
+    }
+
+    /* Follows the references with getSlot, optionally without the last one */
+    Operand compileReference(NReference& ref, bool ignoreLast) {
+        Operand current = compileIdentifier(*ref.refs.front());
+        IdentifierList::const_iterator it;
+        for (it = ref.refs.begin() + 1; it != ref.refs.end(); it++) {
+            if (ignoreLast && it == ref.refs.end() - 1) break;
+            uint16_t reg = allocateRegister();
+            emit(OpCode::GetSlot, reg, current.reg, addSymbol((*it)->name.str()));
+            current = Operand { reg, VariableType::Object };
+        }
+        return current;
+    }
+
+    Operand compileCall(NMethodCall& call) {
+        string name = call.ref.refs.front()->name.str();
+        VariableList *params = parameters[name];
+        bool isNative = natives.count(name) > 0;
+        if (!isNative && functions.count(name) == 0) {
+            fail("no such function " + name);
+            return Operand { 0, VariableType::Void };
+        }
+        if (params == NULL || params->size() != call.arguments.size()) {
+            fail("wrong number of arguments to " + name);
+            return Operand { 0, VariableType::Void };
+        }
+
+        vector<Operand> args;
+        for (size_t i = 0; i < call.arguments.size(); i++)
+            args.push_back(convert(compileExpression(*call.arguments[i]), (*params)[i]->type));
+
+        /* Arguments are passed in consecutive registers */
+        uint16_t argStart = nextRegister;
+        for (size_t i = 0; i < args.size(); i++)
+            emit(OpCode::Move, allocateRegister(), args[i].reg);
+
+        uint16_t result = allocateRegister();
+        if (isNative)
+            emit(OpCode::CallNative, result, natives[name], argStart);
+        else
+            emit(OpCode::Call, result, functions[name], argStart);
+        return Operand { result, returnTypes[name] };
+    }
+
+    Operand compileBinary(NBinaryOperator& binary) {
+        Operand lhs = compileExpression(binary.lhs);
+        Operand rhs = compileExpression(binary.rhs);
+        bool isDouble = lhs.type == VariableType::Double || rhs.type == VariableType::Double;
+        VariableType type = isDouble ? VariableType::Double : VariableType::Integer;
+        lhs = convert(lhs, type);
+        rhs = convert(rhs, type);
+
+        OpCode op;
+        bool swap = false;
+        switch (binary.op) {
+            case TPLUS:  op = isDouble ? OpCode::AddDouble : OpCode::AddInt; break;
+            case TMINUS: op = isDouble ? OpCode::SubDouble : OpCode::SubInt; break;
+            case TMUL:   op = isDouble ? OpCode::MulDouble : OpCode::MulInt; break;
+            case TDIV:   op = isDouble ? OpCode::DivDouble : OpCode::DivInt; break;
+            case TCEQ:   op = isDouble ? OpCode::EqualDouble : OpCode::EqualInt; break;
+            case TCNE:   op = isDouble ? OpCode::NotEqualDouble : OpCode::NotEqualInt; break;
+            case TCLT:   op = isDouble ? OpCode::LessDouble : OpCode::LessInt; break;
+            case TCLE:   op = isDouble ? OpCode::LessEqualDouble : OpCode::LessEqualInt; break;
+            case TCGT:   op = isDouble ? OpCode::LessDouble : OpCode::LessInt; swap = true; break;
+            case TCGE:   op = isDouble ? OpCode::LessEqualDouble : OpCode::LessEqualInt; swap = true; break;
+            default:
+                fail("unsupported operator " + to_string(binary.op));
+                return lhs;
+        }
+        /* Comparisons give 1 or 0 */
+        if (op >= OpCode::EqualInt && op <= OpCode::LessEqualDouble) type = VariableType::Integer;
+        uint16_t reg = allocateRegister();
+        if (swap)
+            emit(op, reg, rhs.reg, lhs.reg);
+        else
+            emit(op, reg, lhs.reg, rhs.reg);
+        return Operand { reg, type };
+    }
+
+    /* Register that is zero when the condition is false */
+    uint16_t compileCondition(NExpression& condition) {
+        Operand value = compileExpression(condition);
+        if (value.type == VariableType::Double) {
+            VMValue zero;
+            zero.number = 0;
+            uint16_t zeroReg = allocateRegister();
+            emit(OpCode::LoadConst, zeroReg, addConstant(zero));
+            uint16_t reg = allocateRegister();
+            emit(OpCode::NotEqualDouble, reg, value.reg, zeroReg);
+            return reg;
+        }
+        if (value.type != VariableType::Integer) fail("condition is not a number");
+        return value.reg;
+    }
+
+    void compileIf(NIfStatement& ifStatement) {
+        size_t skipThen = emitJump(OpCode::JumpIfFalse, compileCondition(*ifStatement.condition));
+        compileBlock(ifStatement.thenBlock);
+        if (ifStatement.elseBlock == NULL) {
+            patch(skipThen, label());
+            return;
+        }
+        size_t skipElse = emitJump(OpCode::Jump);
+        patch(skipThen, label());
+        compileBlock(*ifStatement.elseBlock);
+        patch(skipElse, label());
+    }
+
+    /* The table jumps to the case of a sayı value. For a yazı value it
+       jumps to the literals with the hash of the value, which are
+       compared one after the other. */
+    void compileSwitch(NSwitchStatement& statement) {
+        Operand subject = compileExpression(*statement.value);
+        bool strings = subject.type == VariableType::String;
+        if (!strings && subject.type != VariableType::Integer) {
+            fail("şartlıgir on a value that is not sayı or yazı");
+            return;
+        }
+        if (proto->switchTables.size() == MaxRegisters) {
+            fail("too many şartlıgir");
+            return;
+        }
+
+        /* Key of every literal and the case or hash bucket it jumps to */
+        map<int64_t, size_t> keys;
+        vector<vector<pair<NString *, size_t>>> buckets;
+        for (size_t i = 0; i < statement.cases.size(); i++) {
+            for (NExpression *literal : statement.cases[i]->values) {
+                if (!strings) {
+                    keys[static_cast<NInteger *>(literal)->value] = i;
+                    continue;
+                }
+                NString *str = static_cast<NString *>(literal);
+                int64_t hash = (int64_t) strhash(str->value.data());
+                if (keys.count(hash) == 0) {
+                    keys[hash] = buckets.size();
+                    buckets.push_back(vector<pair<NString *, size_t>>());
+                }
+                buckets[keys[hash]].push_back(make_pair(str, i));
+            }
+        }
+
+        uint16_t key = subject.reg;
+        if (strings) {
+            key = allocateRegister();
+            emit(OpCode::HashString, key, subject.reg);
+        }
+        bool dense = isDense(keys);
+        size_t tableIndex = proto->switchTables.size();
+        proto->switchTables.push_back(SwitchTable());
+        emit(dense ? OpCode::JumpTable : OpCode::SearchTable, key, tableIndex);
+
+        /* Jumps to each case and to the kabul block, patched below */
+        vector<vector<size_t>> caseJumps(statement.cases.size());
+        vector<size_t> defaultJumps;
+        vector<uint16_t> bucketLabels;
+        for (vector<pair<NString *, size_t>>& bucket : buckets) {
+            bucketLabels.push_back(label());
+            for (pair<NString *, size_t>& candidate : bucket) {
+                uint16_t literal = allocateRegister();
+                emit(OpCode::LoadConst, literal, addString(candidate.first->value.str()));
+                uint16_t equal = allocateRegister();
+                emit(OpCode::EqualString, equal, subject.reg, literal);
+                size_t mismatch = emitJump(OpCode::JumpIfFalse, equal);
+                caseJumps[candidate.second].push_back(emitJump(OpCode::Jump));
+                patch(mismatch, label());
+            }
+            defaultJumps.push_back(emitJump(OpCode::Jump));
+        }
+
+        vector<uint16_t> caseLabels;
+        vector<size_t> endJumps;
+        for (size_t i = 0; i < statement.cases.size(); i++) {
+            caseLabels.push_back(label());
+            for (size_t jump : caseJumps[i]) patch(jump, caseLabels.back());
+            compileBlock(statement.cases[i]->block);
+            endJumps.push_back(emitJump(OpCode::Jump));
+        }
+        uint16_t otherwise = label();
+        if (statement.defaultBlock) compileBlock(*statement.defaultBlock);
+        uint16_t end = label();
+        for (size_t jump : defaultJumps) patch(jump, otherwise);
+        for (size_t jump : endJumps) patch(jump, end);
+
+        SwitchTable& table = proto->switchTables[tableIndex];
+        const vector<uint16_t>& labels = strings ? bucketLabels : caseLabels;
+        table.otherwise = otherwise;
+        table.low = keys.empty() ? 0 : keys.begin()->first;
+        if (dense) table.targets.assign((uint64_t) keys.rbegin()->first - (uint64_t) table.low + 1, otherwise);
+        for (pair<const int64_t, size_t>& entry : keys) {
+            if (dense) {
+                table.targets[(uint64_t) entry.first - (uint64_t) table.low] = labels[entry.second];
+            } else {
+                table.keys.push_back(entry.first);
+                table.targets.push_back(labels[entry.second]);
+            }
+        }
+        LOG(LogLevel::Verbose, "şartlıgir with " + to_string(keys.size()) + (dense ? " keys in a jump table" : " keys to search"));
+    }
+
+    /* init, then the condition at the top of every iteration */
+    void compileLoop(NLoopStatement& loop) {
+        if (proto == program.functions[0]) program.topLevelLoops = true;
+        if (loop.init) compileStatement(*loop.init);
+        uint16_t top = label();
+        size_t exit = 0;
+        if (loop.condition) exit = emitJump(OpCode::JumpIfFalse, compileCondition(*loop.condition));
+
+        loops.push_back(LoopJumps());
+        compileBlock(loop.block);
+        uint16_t next = label();
+        if (loop.step) compileExpression(*loop.step);
+        emit(OpCode::Loop, top);
+        uint16_t end = label();
+
+        if (loop.condition) patch(exit, end);
+        for (size_t jump : loops.back().breaks) patch(jump, end);
+        for (size_t jump : loops.back().continues) patch(jump, next);
+        loops.pop_back();
+    }
+
+    Operand compileAssignment(NAssignment& assignment) {
+        if (assignment.lhs.refs.size() == 1) {
+            map<string, Operand>::iterator it = locals.find(assignment.lhs.refs.front()->name.str());
+            if (it == locals.end()) {
+                fail("assignment to undeclared " + assignment.lhs.refs.front()->name.str());
+                return Operand { 0, VariableType::Void };
+            }
+            Operand value = convert(compileExpression(assignment.rhs), it->second.type);
+            emit(OpCode::Move, it->second.reg, value.reg);
+            return it->second;
+        }
+
+        Operand object = compileReference(assignment.lhs, true);
+        Operand value = convert(compileExpression(assignment.rhs), VariableType::Object);
+        emit(OpCode::PutSlot, object.reg, addSymbol(assignment.lhs.refs.back()->name.str()), value.reg);
+        return value;
+    }
+
+    Operand compileExpression(NExpression& expr) {
+        if (NInteger *integer = dynamic_cast<NInteger *>(&expr)) {
+            VMValue value;
+            value.integer = integer->value;
+            uint16_t reg = allocateRegister();
+            emit(OpCode::LoadConst, reg, addConstant(value));
+            return Operand { reg, VariableType::Integer };
+        }
+        if (NDouble *number = dynamic_cast<NDouble *>(&expr)) {
+            VMValue value;
+            value.number = number->value;
+            uint16_t reg = allocateRegister();
+            emit(OpCode::LoadConst, reg, addConstant(value));
+            return Operand { reg, VariableType::Double };
+        }
+        if (NString *str = dynamic_cast<NString *>(&expr)) {
+            uint16_t reg = allocateRegister();
+            emit(OpCode::LoadConst, reg, addString(str->value.str()));
+            return Operand { reg, VariableType::String };
+        }
+        if (NIdentifier *ident = dynamic_cast<NIdentifier *>(&expr))
+            return compileIdentifier(*ident);
+        if (NMethodCall *call = dynamic_cast<NMethodCall *>(&expr))
+            return compileCall(*call);
+        if (NReference *ref = dynamic_cast<NReference *>(&expr))
+            return compileReference(*ref, false);
+        if (NBinaryOperator *binary = dynamic_cast<NBinaryOperator *>(&expr))
+            return compileBinary(*binary);
+        if (NAssignment *assignment = dynamic_cast<NAssignment *>(&expr))
+            return compileAssignment(*assignment);
+        if (NBlock *block = dynamic_cast<NBlock *>(&expr))
+            return compileBlock(*block);
+
+        fail(string("unsupported expression ") + typeid(expr).name());
+        return Operand { 0, VariableType::Void };
+    }
+
+    Operand compileStatement(NStatement& stmt) {
+        if (NExpressionStatement *expr = dynamic_cast<NExpressionStatement *>(&stmt))
+            return compileExpression(expr->expression);
+
+        if (NReturnStatement *ret = dynamic_cast<NReturnStatement *>(&stmt)) {
+            Operand value = compileExpression(ret->expression);
+            VariableType type = proto->declaration ? proto->declaration->type : VariableType::Void;
+            if (type != VariableType::Void) value = convert(value, type);
+            emit(OpCode::SetReturn, value.reg);
+            emit(OpCode::Return, 0);
+            return value;
+        }
+
+        if (NIfStatement *ifStatement = dynamic_cast<NIfStatement *>(&stmt)) {
+            compileIf(*ifStatement);
+            return Operand { 0, VariableType::Void };
+        }
+
+        if (NLoopStatement *loop = dynamic_cast<NLoopStatement *>(&stmt)) {
+            compileLoop(*loop);
+            return Operand { 0, VariableType::Void };
+        }
+
+        if (NSwitchStatement *switchStatement = dynamic_cast<NSwitchStatement *>(&stmt)) {
+            compileSwitch(*switchStatement);
+            return Operand { 0, VariableType::Void };
+        }
+
+        if (dynamic_cast<NBreakStatement *>(&stmt) || dynamic_cast<NContinueStatement *>(&stmt)) {
+            if (loops.empty()) {
+                fail("çık or atla outside of a loop");
+                return Operand { 0, VariableType::Void };
+            }
+            LoopJumps& jumps = loops.back();
+            (dynamic_cast<NBreakStatement *>(&stmt) ? jumps.breaks : jumps.continues).push_back(emitJump(OpCode::Jump));
+            return Operand { 0, VariableType::Void };
+        }
+
+        if (NVariableDeclaration *decl = dynamic_cast<NVariableDeclaration *>(&stmt)) {
+            uint16_t reg = declareLocal(decl->id.name.str(), decl->type);
+            if (decl->assignmentExpr != NULL) {
+                Operand value = convert(compileExpression(*decl->assignmentExpr), decl->type);
+                emit(OpCode::Move, reg, value.reg);
+            }
+            return Operand { reg, decl->type };
+        }
+
+        if (NExternDeclaration *decl = dynamic_cast<NExternDeclaration *>(&stmt)) {
+            declareExtern(*decl);
+            return Operand { 0, VariableType::Void };
+        }
+
+        if (dynamic_cast<NFunctionDeclaration *>(&stmt)) {
+            if (proto != program.functions[0]) fail("nested function declaration");
+            return Operand { 0, VariableType::Void };
+        }
+
+        fail(string("unsupported statement ") + typeid(stmt).name());
+        return Operand { 0, VariableType::Void };
+    }
+
+    Operand compileBlock(NBlock& block) {
+        Operand last = { 0, VariableType::Void };
+        uint16_t base = nextRegister;
+        StatementList::const_iterator it;
+        for (it = block.statements.begin(); it != block.statements.end() && !failed; it++) {
+            /* Temporaries of the previous statement are dead, the value
+               of the last one is the value of the block */
+            if (it != block.statements.begin())
+                nextRegister = max(base, localsTop);
+            last = compileStatement(**it);
+        }
+        return last;
+    }
+
+    void declareExtern(NExternDeclaration& decl) {
+        VariableList::const_iterator it;
+        for (it = decl.arguments.begin(); it != decl.arguments.end(); it++) {
+            if ((*it)->type == VariableType::Double) {
+                fail("extern with double arguments");
+                return;
+            }
+        }
+        if (decl.type == VariableType::Double || decl.arguments.size() > 6) {
+            fail("unsupported extern signature " + decl.id.name.str());
+            return;
+        }
+
+        void *address = dlsym(RTLD_DEFAULT, decl.id.name.str().c_str());
+        if (address == NULL) {
+            fail("unresolved extern " + decl.id.name.str());
+            return;
+        }
+        NativeProto native = { decl.id.name.str(), (uint16_t) decl.arguments.size(), NULL, address };
+        natives[decl.id.name.str()] = program.natives.size();
+        parameters[decl.id.name.str()] = &decl.arguments;
+        returnTypes[decl.id.name.str()] = decl.type;
+        program.natives.push_back(native);
+    }
+
+    void beginFunction(FunctionProto *function) {
+        proto = function;
+        locals.clear();
+        loops.clear();
+        localsTop = nextRegister = 0;
+    }
+
+public:
+    BytecodeCompiler(BytecodeProgram& program) : program(program), proto(NULL), failed(false) { }
+
+    void addBuiltin(const string& name, VariableType argType, NativeFunction function) {
+        static VariableList integerArgs(1, new NVariableDeclaration(VariableType::Integer, *new NIdentifier("sayi")));
+        static VariableList stringArgs(1, new NVariableDeclaration(VariableType::String, *new NIdentifier("yazi")));
+        NativeProto native = { name, 1, function, NULL };
+        natives[name] = program.natives.size();
+        parameters[name] = argType == VariableType::Integer ? &integerArgs : &stringArgs;
+        returnTypes[name] = VariableType::Void;
+        program.natives.push_back(native);
+    }
+
+    bool compile(NBlock& root) {
+        FunctionProto *main = new FunctionProto();
+        main->name = "main";
+        program.functions.push_back(main);
+
+        /* Declare every function first so calls can be resolved */
+        StatementList::const_iterator it;
+        for (it = root.statements.begin(); it != root.statements.end(); it++) {
+            NFunctionDeclaration *decl = dynamic_cast<NFunctionDeclaration *>(*it);
+            if (decl == NULL) continue;
+            /* Registers are untyped, generic functions only run in the JIT */
+            if (decl->isGeneric()) return fail("generic function " + decl->id.name.str());
+            FunctionProto *function = new FunctionProto();
+            function->name = decl->id.name.str();
+            function->declaration = decl;
+            function->numArgs = decl->arguments.size();
+            functions[decl->id.name.str()] = program.functions.size();
+            parameters[decl->id.name.str()] = &decl->arguments;
+            returnTypes[decl->id.name.str()] = decl->type;
+            program.functions.push_back(function);
+        }
+
+        beginFunction(main);
+        compileBlock(root);
+        emit(OpCode::Return, 0);
+
+        for (size_t i = 1; i < program.functions.size() && !failed; i++) {
+            FunctionProto *function = program.functions[i];
+            beginFunction(function);
+            VariableList::const_iterator arg;
+            for (arg = function->declaration->arguments.begin(); arg != function->declaration->arguments.end(); arg++)
+                declareLocal((*arg)->id.name.str(), (*arg)->type);
+            compileBlock(function->declaration->block);
+            emit(OpCode::Return, 0);
+        }
+
+        LOG(LogLevel::Debug, "Bytecode is " + string(failed ? "not " : "") + "generated.");
+        return !failed;
+    }
+};
+
+static int64_t echoInteger(int64_t *args)
+{
+    printf("%d\n", (int) args[0]);
+    return 0;
+}
+
+static int64_t echoString(int64_t *args)
+{
+    printf("%s\n", (const char *) args[0]);
+    return 0;
+}
+
+bool compileBytecode(NBlock& root, BytecodeProgram& program)
+{
+    TRACE_SCOPE("vm", "compileBytecode");
+    BytecodeCompiler compiler(program);
+    compiler.addBuiltin("sayi_yaz", VariableType::Integer, echoInteger);
+    compiler.addBuiltin("yazi_yaz", VariableType::String, echoString);
+    return compiler.compile(root);
+}
@@ -0,0 +1,288 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include "interpreter.h"
+#include "tier.h"
+#include "../logger.h"
+#include "../trace.h"
+
+using namespace std;
+
+extern "C" {
+mObject* getSlot(mObject *self, SymbolID slot, int followChain);
+void putSlot(mObject *self, SymbolID slot, mObject *value);
+mObject* newobj(mObject *prototype);
+}
+
+static const size_t StackSize = 1 << 20;
+
+/* Unboxing checks the shape of the box like generated code does */
+static inline void checkShape(mObject *object, Shape *kind)
+{
+    if (object->shape != kind)
+        checkBox(object, kind);
+}
+
+/* The stack is mapped without swap reservation, short programs only
+   fault in the pages of their few frames */
+Interpreter::Interpreter(BytecodeProgram& program, TierCompiler *tier, uint64_t threshold)
+    : program(program), tier(tier), threshold(threshold), stackSize(StackSize), stackTop(0)
+{
+    void *base = mmap(NULL, StackSize * sizeof(VMValue), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+    stack = base == MAP_FAILED ? NULL : (VMValue *) base;
+    if (stack == NULL) stackSize = 0;
+    roots.begin = roots.end = (void **) stack;
+}
+
+Interpreter::~Interpreter()
+{
+    if (stack) munmap(stack, StackSize * sizeof(VMValue));
+}
+
+int Interpreter::run()
+{
+    if (stack == NULL) {
+        LOG(LogLevel::Error, "Could not map the interpreter stack");
+        return 1;
+    }
+    LOG(LogLevel::Debug, "Interpreting bytecode...");
+    TRACE_SCOPE("vm", "interpret");
+    gcPushRootRange(&roots);
+    call(program.functions[0], NULL);
+    gcPopRootRange(&roots);
+    LOG(LogLevel::Info, "\033[0;32mCode was run.\x1b[0m");
+    return 0;
+}
+
+void Interpreter::tierUp(FunctionProto *function)
+{
+    LOG(LogLevel::Debug, "Promoting hot function: " + function->name);
+    TRACE_SCOPE("vm", "tierUp", function->name);
+    function->jitEntry = tier->compile(function->name);
+    if (function->jitEntry == NULL)
+        function->jitFailed = true;
+}
+
+VMValue Interpreter::call(FunctionProto *function, VMValue *args)
+{
+    if (stackTop + function->numRegisters > stackSize) {
+        LOG(LogLevel::Error, "Stack overflow in " + function->name);
+        exit(1);
+    }
+
+    VMValue *regs = &stack[stackTop];
+    memset(regs, 0, sizeof(VMValue) * function->numRegisters);
+    for (uint16_t i = 0; i < function->numArgs; i++)
+        regs[i] = args[i];
+
+    stackTop += function->numRegisters;
+    roots.end = (void **) (stack + stackTop);
+    VMValue result = execute(function, regs);
+    stackTop -= function->numRegisters;
+    roots.end = (void **) (stack + stackTop);
+    return result;
+}
+
+VMValue Interpreter::callNative(const NativeProto& native, VMValue *args)
+{
+    int64_t *raw = (int64_t *) args;
+    VMValue result;
+    if (native.function) {
+        result.integer = native.function(raw);
+        return result;
+    }
+
+    /* Externs take integer or pointer arguments only */
+    switch (native.numArgs) {
+        case 0: result.integer = ((int64_t (*)()) native.external)(); break;
+        case 1: result.integer = ((int64_t (*)(int64_t)) native.external)(raw[0]); break;
+        case 2: result.integer = ((int64_t (*)(int64_t, int64_t)) native.external)(raw[0], raw[1]); break;
+        case 3: result.integer = ((int64_t (*)(int64_t, int64_t, int64_t)) native.external)(raw[0], raw[1], raw[2]); break;
+        case 4: result.integer = ((int64_t (*)(int64_t, int64_t, int64_t, int64_t)) native.external)(
+                    raw[0], raw[1], raw[2], raw[3]); break;
+        case 5: result.integer = ((int64_t (*)(int64_t, int64_t, int64_t, int64_t, int64_t)) native.external)(
+                    raw[0], raw[1], raw[2], raw[3], raw[4]); break;
+        default: result.integer = ((int64_t (*)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t)) native.external)(
+                    raw[0], raw[1], raw[2], raw[3], raw[4], raw[5]); break;
+    }
+    return result;
+}
+
+VMValue Interpreter::execute(FunctionProto *function, VMValue *regs)
+{
+    const Instruction *pc = function->code.data();
+    const VMValue *constants = function->constants.data();
+    VMValue returnValue;
+    returnValue.integer = 0;
+
+    for (;;) {
+        const Instruction& ins = *pc++;
+        switch (ins.op) {
+            case OpCode::LoadConst:
+                regs[ins.a] = constants[ins.b];
+                break;
+            case OpCode::Move:
+                regs[ins.a] = regs[ins.b];
+                break;
+            /* Integers wrap around like i64 instructions in generated code */
+            case OpCode::AddInt:
+                regs[ins.a].integer = (int64_t) ((uint64_t) regs[ins.b].integer + (uint64_t) regs[ins.c].integer);
+                break;
+            case OpCode::SubInt:
+                regs[ins.a].integer = (int64_t) ((uint64_t) regs[ins.b].integer - (uint64_t) regs[ins.c].integer);
+                break;
+            case OpCode::MulInt:
+                regs[ins.a].integer = (int64_t) ((uint64_t) regs[ins.b].integer * (uint64_t) regs[ins.c].integer);
+                break;
+            case OpCode::DivInt:
+                if (regs[ins.c].integer == 0)
+                    divisionByZero();
+                /* x / -1 is -x, so LLONG_MIN / -1 wraps around to LLONG_MIN */
+                if (regs[ins.c].integer == -1)
+                    regs[ins.a].integer = (int64_t) (0 - (uint64_t) regs[ins.b].integer);
+                else
+                    regs[ins.a].integer = regs[ins.b].integer / regs[ins.c].integer;
+                break;
+            case OpCode::AddDouble:
+                regs[ins.a].number = regs[ins.b].number + regs[ins.c].number;
+                break;
+            case OpCode::SubDouble:
+                regs[ins.a].number = regs[ins.b].number - regs[ins.c].number;
+                break;
+            case OpCode::MulDouble:
+                regs[ins.a].number = regs[ins.b].number * regs[ins.c].number;
+                break;
+            case OpCode::DivDouble:
+                regs[ins.a].number = regs[ins.b].number / regs[ins.c].number;
+                break;
+            case OpCode::IntToDouble:
+                regs[ins.a].number = (double) regs[ins.b].integer;
+                break;
+            case OpCode::EqualInt:
+                regs[ins.a].integer = regs[ins.b].integer == regs[ins.c].integer;
+                break;
+            case OpCode::NotEqualInt:
+                regs[ins.a].integer = regs[ins.b].integer != regs[ins.c].integer;
+                break;
+            case OpCode::LessInt:
+                regs[ins.a].integer = regs[ins.b].integer < regs[ins.c].integer;
+                break;
+            case OpCode::LessEqualInt:
+                regs[ins.a].integer = regs[ins.b].integer <= regs[ins.c].integer;
+                break;
+            case OpCode::EqualDouble:
+                regs[ins.a].integer = regs[ins.b].number == regs[ins.c].number;
+                break;
+            case OpCode::NotEqualDouble:
+                regs[ins.a].integer = regs[ins.b].number != regs[ins.c].number;
+                break;
+            case OpCode::LessDouble:
+                regs[ins.a].integer = regs[ins.b].number < regs[ins.c].number;
+                break;
+            case OpCode::LessEqualDouble:
+                regs[ins.a].integer = regs[ins.b].number <= regs[ins.c].number;
+                break;
+            case OpCode::Jump:
+                pc = function->code.data() + ins.a;
+                break;
+            case OpCode::Loop:
+                pc = function->code.data() + ins.a;
+                /* Without OSR the running call stays interpreted, the
+                   next calls of a function with a hot loop run the machine code */
+                if (function->jitEntry == NULL && tier != NULL && !function->jitFailed &&
+                    function != program.functions[0] && ++function->callCount >= threshold)
+                    tierUp(function);
+                break;
+            case OpCode::JumpIfFalse:
+                if (regs[ins.a].integer == 0)
+                    pc = function->code.data() + ins.b;
+                break;
+            case OpCode::JumpTable: {
+                const SwitchTable& table = function->switchTables[ins.b];
+                uint64_t index = (uint64_t) regs[ins.a].integer - (uint64_t) table.low;
+                pc = function->code.data() + (index < table.targets.size() ? table.targets[index] : table.otherwise);
+                break;
+            }
+            case OpCode::SearchTable: {
+                const SwitchTable& table = function->switchTables[ins.b];
+                vector<int64_t>::const_iterator key = lower_bound(table.keys.begin(), table.keys.end(), regs[ins.a].integer);
+                bool found = key != table.keys.end() && *key == regs[ins.a].integer;
+                pc = function->code.data() + (found ? table.targets[key - table.keys.begin()] : table.otherwise);
+                break;
+            }
+            case OpCode::HashString:
+                regs[ins.a].integer = strhash(regs[ins.b].string);
+                break;
+            case OpCode::EqualString:
+                regs[ins.a].integer = strcmp(regs[ins.b].string, regs[ins.c].string) == 0;
+                break;
+            case OpCode::Box:
+                switch (ins.c) {
+                    case VariableType::Integer:
+                        regs[ins.a].object = &intalloc(regs[ins.b].integer)->object;
+                        break;
+                    case VariableType::Double:
+                        regs[ins.a].object = &dblalloc(regs[ins.b].number)->object;
+                        break;
+                    default:
+                        regs[ins.a].object = &stralloc((char *) regs[ins.b].string, strlen(regs[ins.b].string))->object;
+                        break;
+                }
+                break;
+            case OpCode::Unbox: {
+                mObject *box = regs[ins.b].object;
+                if (box == NULL) {
+                    regs[ins.a].integer = 0;
+                    break;
+                }
+                switch (ins.c) {
+                    case VariableType::Integer:
+                        checkShape(box, &integerShape);
+                        regs[ins.a].integer = ((cinteger *) box)->value;
+                        break;
+                    case VariableType::Double:
+                        checkShape(box, &doubleShape);
+                        regs[ins.a].number = ((cdouble *) box)->value;
+                        break;
+                    default:
+                        checkShape(box, &stringShape);
+                        regs[ins.a].string = ((cstring *) box)->ptr;
+                        break;
+                }
+                break;
+            }
+            case OpCode::NewObject:
+                regs[ins.a].object = newobj(NULL);
+                break;
+            case OpCode::GetSlot:
+                regs[ins.a].object = getSlot(regs[ins.b].object, (SymbolID) constants[ins.c].integer, 1);
+                break;
+            case OpCode::PutSlot:
+                putSlot(regs[ins.a].object, (SymbolID) constants[ins.b].integer, regs[ins.c].object);
+                break;
+            case OpCode::Call: {
+                FunctionProto *callee = program.functions[ins.b];
+                if (callee->jitEntry == NULL && tier != NULL && !callee->jitFailed &&
+                    ++callee->callCount >= threshold)
+                    tierUp(callee);
+                if (callee->jitEntry)
+                    regs[ins.a].integer = callee->jitEntry((int64_t *) (regs + ins.c));
+                else
+                    regs[ins.a] = call(callee, regs + ins.c);
+                break;
+            }
+            case OpCode::CallNative:
+                regs[ins.a] = callNative(program.natives[ins.b], regs + ins.c);
+                break;
+            case OpCode::SetReturn:
+                returnValue = regs[ins.a];
+                break;
+            case OpCode::Return:
+                return returnValue;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef interpreter_h
+#define interpreter_h
+
+#include "bytecode.h"
+#include "../core/gc.h"
+
+class TierCompiler;
+
+/* Register based interpreter of a bytecode program. Functions called or
+   looping more often than the threshold are promoted to machine code by
+   the tier compiler, when there is one. */
+class Interpreter {
+    BytecodeProgram& program;
+    TierCompiler *tier;
+    uint64_t threshold;
+    /* Reserved up front, the pages are only touched by the frames in use */
+    VMValue *stack;
+    size_t stackSize;
+    size_t stackTop;
+    /* The registers in use, the collector scans them conservatively */
+    GCRootRange roots;
+
+    VMValue call(FunctionProto *function, VMValue *args);
+    VMValue callNative(const NativeProto& native, VMValue *args);
+    VMValue execute(FunctionProto *function, VMValue *regs);
+    void tierUp(FunctionProto *function);
+
+public:
+    Interpreter(BytecodeProgram& program, TierCompiler *tier, uint64_t threshold);
+    Interpreter(const Interpreter&) = delete;
+    ~Interpreter();
+
+    /* Runs the top level code, returns the exit code of the program */
+    int run();
+};
+
+#endif // interpreter_h
@@ -0,0 +1,124 @@
+#include "tier.h"
+#include "../core/codegen.h"
+#include "../core/lazyjit.h"
+#include "../language.h"
+
+using namespace std;
+
+void createCoreFunctions(CodeGenContext& context);
+
+/* Emits `i64 vm.entry.<name>(i64* args)`, which unpacks raw register
+   values into the arguments of the function and packs its result */
+static void emitEntry(CodeGenContext& context, Function *function)
+{
+    LLVMContext& llvmContext = context.module->getContext();
+    Type *int64 = Type::getInt64Ty(llvmContext);
+    FunctionType *type = FunctionType::get(int64, PointerType::getUnqual(int64), false);
+    Function *entry = Function::Create(type, GlobalValue::ExternalLinkage,
+        "vm.entry." + function->getName(), context.module);
+    IRBuilder<> builder(BasicBlock::Create(llvmContext, "entry", entry));
+
+    Value *args = &*entry->arg_begin();
+    vector<Value*> callArgs;
+    unsigned index = 0;
+    for (Argument& param : function->args()) {
+        Value *raw = builder.CreateLoad(builder.CreateConstGEP1_32(args, index++));
+        Type *paramType = param.getType();
+        if (paramType->isDoubleTy())
+            raw = builder.CreateBitCast(raw, paramType);
+        else if (paramType->isPointerTy())
+            raw = builder.CreateIntToPtr(raw, paramType);
+        callArgs.push_back(raw);
+    }
+
+    Value *result = builder.CreateCall(function, callArgs);
+    Type *returnType = function->getReturnType();
+    if (returnType->isVoidTy())
+        result = ConstantInt::get(int64, 0);
+    else if (returnType->isDoubleTy())
+        result = builder.CreateBitCast(result, int64);
+    else if (returnType->isPointerTy())
+        result = builder.CreatePtrToInt(result, int64);
+    builder.CreateRet(result);
+}
+
+/* Interns the slot names of the compiled functions before they are called */
+static bool initializeSymbols(void (*symbolInit)())
+{
+    if (symbolInit == NULL) {
+        LOG(LogLevel::Error, "No symbol initializer in the JIT tier");
+        return false;
+    }
+    symbolInit();
+    return true;
+}
+
+TierCompiler::TierCompiler(NBlock& root, const CompilerOptions& options)
+    : root(root), options(options), engine(NULL), initialized(false), failed(false)
+{
+}
+
+TierCompiler::~TierCompiler()
+{
+    retireInlineCaches();
+    delete engine;
+}
+
+bool TierCompiler::initialize()
+{
+    initialized = true;
+    LOG(LogLevel::Debug, "Initializing the JIT tier...");
+    initializeLanguage();
+
+    /* The context owns the LLVMContext of the module, it lives as long as the JIT */
+    codeGenContext.reset(new CodeGenContext(options));
+    CodeGenContext& context = *codeGenContext;
+    createCoreFunctions(context);
+    if (!context.generateFunctions(root))
+        return false;
+
+    StatementList::const_iterator it;
+    for (it = root.statements.begin(); it != root.statements.end(); it++) {
+        NFunctionDeclaration *decl = dynamic_cast<NFunctionDeclaration *>(*it);
+        if (decl == NULL) continue;
+        Function *function = context.module->getFunction(decl->id.name);
+        if (function) emitEntry(context, function);
+    }
+    if (!context.optimize())
+        return false;
+
+    unique_ptr<Module> module(context.module);
+    TargetMachine *tm = EngineBuilder().setOptLevel(context.codeGenOptLevel()).selectTarget();
+    if (tm && LazyJIT::isSupported(*tm)) {
+        lazyJIT.reset(new LazyJIT(tm));
+        lazyJIT->addModule(move(module));
+        return initializeSymbols((void (*)()) lazyJIT->findSymbol("sym.init").getAddress());
+    }
+    delete tm;
+
+    string error;
+    engine = EngineBuilder(move(module))
+        .setErrorStr(&error)
+        .setOptLevel(context.codeGenOptLevel())
+        .create();
+    if (engine == NULL) {
+        LOG(LogLevel::Error, "Could not create the JIT tier: " + error);
+        return false;
+    }
+    engine->RegisterJITEventListener(codeSizeListener());
+    engine->finalizeObject();
+    return initializeSymbols((void (*)()) engine->getFunctionAddress("sym.init"));
+}
+
+JITEntry TierCompiler::compile(const string& name)
+{
+    if (!initialized)
+        failed = !initialize();
+    if (failed)
+        return NULL;
+
+    string entry = "vm.entry." + name;
+    if (lazyJIT)
+        return (JITEntry) lazyJIT->findSymbol(entry).getAddress();
+    return (JITEntry) engine->getFunctionAddress(entry);
+}
@@ -0,0 +1,35 @@
+#ifndef tier_h
+#define tier_h
+
+#include <memory>
+#include <string>
+#include "bytecode.h"
+#include "../options.h"
+
+class CodeGenContext;
+class LazyJIT;
+namespace llvm { class ExecutionEngine; }
+
+/* Compiles the functions of a program with the LLVM code generator when
+   the interpreter finds them hot. The module is generated on the first
+   promotion; with ORC only the promoted functions get machine code. */
+class TierCompiler {
+    NBlock& root;
+    CompilerOptions options;
+    std::unique_ptr<CodeGenContext> codeGenContext;
+    std::unique_ptr<LazyJIT> lazyJIT;
+    llvm::ExecutionEngine *engine;
+    bool initialized;
+    bool failed;
+
+    bool initialize();
+
+public:
+    TierCompiler(NBlock& root, const CompilerOptions& options);
+    ~TierCompiler();
+
+    /* Returns the machine code entry of the function, or null */
+    JITEntry compile(const std::string& name);
+};
+
+#endif // tier_h